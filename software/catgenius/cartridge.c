@@ -0,0 +1,123 @@
+/******************************************************************************/
+/* File    :	cartridge.c						      */
+/* Function:	Detergent cartridge level accounting			      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+#include "../common/app_prefs.h"
+
+#ifdef HAS_CARTRIDGE
+
+#include <htc.h>
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "cartridge.h"
+#include "../common/nvm.h"
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+/* Amounts are in INS_AUTODOSE units of 0.1 ml */
+#define CAPACITY		(CARTRIDGECAPACITY_ML * 10)
+
+/* The level is stored in 2 ml units, so it fits a single setting and can't
+ * be torn in half by a power failure */
+#define NVM_UNIT		20
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+static unsigned int		level		= CAPACITY;	/* Detergent left */
+static unsigned char		wash_use	= 0;		/* Dispensed by the running program */
+static unsigned char		average_use	= 0;		/* Per wash, 0 until the first one */
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+void cartridge_init (void)
+/******************************************************************************/
+/* Function:	cartridge_init						      */
+/*		- Restores the cartridge level from EEPROM		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	level = (unsigned int)nvm_read(NVM_CARTLEVEL) * NVM_UNIT;
+	/* Blank EEPROM: assume a full cartridge */
+	if (level > CAPACITY)
+		level = CAPACITY;
+
+	average_use = nvm_read(NVM_CARTUSE);
+	if (average_use == 0xFF)
+		average_use = 0;
+}
+/* cartridge_init */
+
+
+void cartridge_dose (unsigned int amount)
+{
+	if (wash_use + amount > 0xFF)
+		wash_use = 0xFF;
+	else
+		wash_use += (unsigned char)amount;
+
+	if (amount > level)
+		level = 0;
+	else
+		level -= amount;
+}
+
+void cartridge_commit (void)
+/******************************************************************************/
+/* Function:	cartridge_commit					      */
+/*		- Stores the level after a program, rather than after every   */
+/*		  dose							      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	if (wash_use) {
+		/* Average over the last few washes, short and full ones alike */
+		if (average_use)
+			average_use = (unsigned char)(((unsigned int)average_use * 3 + wash_use + 2) / 4);
+		else
+			average_use = wash_use;
+		wash_use = 0;
+	}
+
+	nvm_write(NVM_CARTLEVEL, (unsigned char)((level + NVM_UNIT / 2) / NVM_UNIT));
+	nvm_write(NVM_CARTUSE, average_use);
+}
+/* cartridge_commit */
+
+void cartridge_set_level (unsigned char percent)
+{
+	if (percent > 100)
+		percent = 100;
+	level = (unsigned int)(((unsigned long)CAPACITY * percent) / 100);
+	cartridge_commit();
+}
+
+unsigned char cartridge_level (void)
+{
+	return (unsigned char)(((unsigned long)level * 100) / CAPACITY);
+}
+
+unsigned int cartridge_left (void)
+{
+	return level;
+}
+
+unsigned char cartridge_use (void)
+{
+	return average_use;
+}
+
+#endif /* HAS_CARTRIDGE */
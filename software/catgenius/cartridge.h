@@ -0,0 +1,28 @@
+/******************************************************************************/
+/* File    :	cartridge.h						      */
+/* Function:	Header file of 'cartridge.c'.				      */
+/******************************************************************************/
+
+#ifndef CARTRIDGE_H			/* Include file already compiled? */
+#define CARTRIDGE_H
+
+#include "../common/app_prefs.h"
+
+#ifdef HAS_CARTRIDGE
+
+/* Generic */
+void		cartridge_init		(void) ;
+
+/* Control */
+void		cartridge_dose		(unsigned int			  amount) ;
+void		cartridge_commit	(void) ;
+void		cartridge_set_level	(unsigned char			  percent) ;
+
+/* Status */
+unsigned char	cartridge_level		(void) ;
+unsigned int	cartridge_left		(void) ;
+unsigned char	cartridge_use		(void) ;
+
+#endif /* HAS_CARTRIDGE */
+
+#endif /* CARTRIDGE_H */
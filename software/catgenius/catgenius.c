@@ -18,11 +18,15 @@
 #include "../common/rtc.h"
 #include "../common/serial.h"
 #include "../common/i2c.h"
+#include "../common/srix4k.h"
 #include "../common/catsensor.h"
 #include "../common/water.h"
 
 #include "userinterface.h"
 #include "litterlanguage.h"
+#include "eepromwashprogram.h"
+#include "rfidwashprogram.h"
+#include "cartridge.h"
 
 #include "../common/cmdline.h"
 #include "../common/cmdline_box.h"
@@ -30,6 +34,8 @@
 #include "../common/cmdline_tag.h"
 #include "../common/bluetooth.h"
 #include "../common/eventlog.h"
+#include "../common/nvm.h"
+#include "../common/frame.h"
 
 
 /******************************************************************************/
@@ -52,6 +58,10 @@
 #  endif
 #endif
 
+/* Time to stay awake after receiving a character, as the one that wakes up
+ * the receiver is lost */
+#define AWAKE_TIME		(2 * SECOND)
+
 
 /******************************************************************************/
 /* Global Data								      */
@@ -63,46 +73,71 @@ extern bit		__timeout;
 #endif /* __RESETBITS_ADDR */
 
 #ifdef HAS_COMMANDLINE
-/* command line commands */
+/* command line commands, sorted by name for a binary search */
 const struct command	commands[] = {
-	{"echo",	cmd_echo},
-	{"help",	cmd_help},
 #ifdef HAS_COMMANDLINE_BOX
-	{"bowl",	cmd_bowl},
 	{"arm",		cmd_arm},
+	{"bowl",	cmd_bowl},
+#endif // HAS_COMMANDLINE_BOX
+#ifdef HAS_COMMANDLINE_EXTRA
+	{"cart",	cmd_cart},
+#endif // HAS_COMMANDLINE_EXTRA
+#ifdef HAS_COMMANDLINE_BOX
+	{"cat",		cmd_cat},
 	{"dosage",	cmd_dosage},
-	{"tap",		cmd_tap},
 	{"drain",	cmd_drain},
 	{"dryer",	cmd_dryer},
-	{"cat",		cmd_cat},
-	{"water",	cmd_water},
+#endif // HAS_COMMANDLINE_BOX
+	{"echo",	cmd_echo},
+#ifdef HAS_EVENTLOG
+	{"evt",		cmd_evt},
+#endif // HAS_EVENTLOG
+#ifdef HAS_COMMANDLINE_GPIO
+	{"gpio",	cmd_gpio},
+#endif // HAS_COMMANDLINE_GPIO
+#ifdef HAS_COMMANDLINE_BOX
 	{"heat",	cmd_heat},
 #endif // HAS_COMMANDLINE_BOX
-#ifdef HAS_COMMANDLINE_TAG
-	{"tag",		cmd_tag},
-#endif // HAS_COMMANDLINE_TAG
+	{"help",	cmd_help},
+#ifdef HAS_COMMANDLINE_EXTRA
+	{"lock",	cmd_lock},
+#endif // HAS_COMMANDLINE_EXTRA
+#ifdef HAS_COMMANDLINE_MACRO
+	{"macro",	cmd_macro},
+#endif // HAS_COMMANDLINE_MACRO
 #ifdef HAS_COMMANDLINE_EXTRA
 	{"mode",	cmd_mode},
-	{"start",	cmd_start},
+#endif // HAS_COMMANDLINE_EXTRA
+#ifdef HAS_EEPROMPROGRAM
+	{"prog",	cmd_prog},
+#endif // HAS_EEPROMPROGRAM
+#ifdef HAS_COMMANDLINE_COMTESTS
+	{"rxtest",	cmd_rxtest},
+#endif // HAS_COMMANDLINE_COMTESTS
+#ifdef HAS_COMMANDLINE_EXTRA
 	{"setup",	cmd_setup},
-	{"lock",	cmd_lock},
-	{"cart",	cmd_cart},
+	{"start",	cmd_start},
 #endif // HAS_COMMANDLINE_EXTRA
+#ifdef HAS_COMMANDLINE_TAG
+	{"tag",		cmd_tag},
+#endif // HAS_COMMANDLINE_TAG
+#ifdef HAS_COMMANDLINE_BOX
+	{"tap",		cmd_tap},
+#endif // HAS_COMMANDLINE_BOX
 #ifdef HAS_COMMANDLINE_COMTESTS
-    {"txtest",	cmd_txtest},
-    {"rxtest",	cmd_rxtest},
+	{"txtest",	cmd_txtest},
 #endif // HAS_COMMANDLINE_COMTESTS
-#ifdef HAS_COMMANDLINE_GPIO
-	{"gpio",	cmd_gpio},
-#endif // HAS_COMMANDLINE_GPIO
-#ifdef HAS_EVENTLOG
-	{"evt",		cmd_evt},
-#endif // HAS_EVENTLOG
+#ifdef HAS_COMMANDLINE_BOX
+	{"water",	cmd_water},
+#endif // HAS_COMMANDLINE_BOX
 	{"", NULL}
 };
 #endif /* HAS_COMMANDLINE */
 
 static unsigned char	PORTB_old;
+#if (defined HAS_SLEEP) && (defined HAS_SERIAL)
+static struct timer	awake		= EXPIRED;
+#endif /* HAS_SLEEP && HAS_SERIAL */
 
 
 /******************************************************************************/
@@ -110,6 +145,9 @@ static unsigned char	PORTB_old;
 /******************************************************************************/
 
 static void interrupt_init (void);
+#ifdef HAS_SLEEP
+static void idle (void);
+#endif /* HAS_SLEEP */
 
 
 /******************************************************************************/
@@ -159,6 +197,11 @@ void main (void)
 	/* Initialize event log */
 	eventlog_init();
 
+#ifdef HAS_NVMJOURNAL
+	/* Restore the settings from the journal */
+	nvm_init();
+#endif /* HAS_NVMJOURNAL */
+
 	/* Initialize software timers */
 	timer_init();
 
@@ -171,6 +214,21 @@ void main (void)
 	/* Initialize the water sensor and valve */
 	water_init();
 
+#ifdef HAS_I2C
+	/* Initialize the I2C bus */
+	i2c_init();
+#endif /* HAS_I2C */
+
+#ifdef HAS_SRIX4K
+	/* Initialize the RFID tag reader */
+	srix4k_init();
+#endif /* HAS_SRIX4K */
+
+#ifdef HAS_CARTRIDGE
+	/* Restore the detergent cartridge level */
+	cartridge_init();
+#endif /* HAS_CARTRIDGE */
+
 	/* Initialize the user interface */
 	userinterface_init(flags);
 
@@ -187,6 +245,7 @@ void main (void)
 
 	/* Execute the run loop */
 	for(;;){
+		timer_work();
 		rtc_work();
 		catsensor_work();
 		water_work();
@@ -196,8 +255,27 @@ void main (void)
 		cmdline_work();
 #endif /* HAS_COMMANDLINE */
 		litterlanguage_work();
+#ifdef HAS_EEPROMPROGRAM
+		eepromwashprogram_work();
+#endif /* HAS_EEPROMPROGRAM */
+#ifdef HAS_SRIX4K
+		srix4k_work();
+#endif /* HAS_SRIX4K */
+#ifdef HAS_RFIDPROGRAM
+		rfidwashprogram_work();
+#endif /* HAS_RFIDPROGRAM */
+#ifdef HAS_NVMJOURNAL
+		nvm_work();
+#endif /* HAS_NVMJOURNAL */
+		eventlog_work();
+#ifdef HAS_FRAMING
+		frame_work();
+#endif /* HAS_FRAMING */
 #ifndef __DEBUG
 		CLRWDT();
+#ifdef HAS_SLEEP
+		idle();
+#endif /* HAS_SLEEP */
 #endif
 	}
 }
@@ -218,6 +296,69 @@ static void interrupt_init (void)
 	GIE = 1;
 }
 
+#ifdef HAS_SLEEP
+static void idle (void)
+{
+	unsigned long	ticks;
+
+	/* Stay awake if anything needs the next pass or a running clock */
+	if (catsensor_busy() || water_busy())
+		return;
+	/* The watchdog runs on the LFINTOSC, which is off by tens of percents,
+	 * so stay on Timer 1 while time matters: for the wait instructions of
+	 * a program, and while counting down to a timed wash */
+	if (litterlanguage_running() ||
+	    ((auto_mode >= AUTO_TIMED1) && (auto_mode <= AUTO_TIMED4)))
+		return;
+#ifdef HAS_COMMANDLINE
+	if (cmdline_busy())
+		return;
+#endif /* HAS_COMMANDLINE */
+#ifdef HAS_EEPROMPROGRAM
+	if (eepromwashprogram_busy())
+		return;
+#endif /* HAS_EEPROMPROGRAM */
+#ifdef HAS_RFIDPROGRAM
+	if (rfidwashprogram_busy())
+		return;
+#endif /* HAS_RFIDPROGRAM */
+#ifdef HAS_NVMJOURNAL
+	if (nvm_busy())
+		return;
+#endif /* HAS_NVMJOURNAL */
+	if (eventlog_busy())
+		return;
+#ifdef HAS_FRAMING
+	if (frame_busy())
+		return;
+#endif /* HAS_FRAMING */
+#ifdef HAS_SERIAL
+	/* Give a host that's talking, or has just been sent ACK, the time to
+	 * go on without having to wake up the box again */
+	if (serial_heard())
+		settimeout(&awake, AWAKE_TIME);
+	if (!serial_idle() || !timeoutexpired(&awake))
+		return;
+#endif /* HAS_SERIAL */
+
+	/* Sleep until the first deadline, unless it's too close */
+	ticks = timer_idle();
+	if (ticks < MILISECOND)
+		return;
+
+	/* Wake-up interrupts are handled after recovering from sleep */
+	GIE = 0;
+#ifdef HAS_SERIAL
+	serial_sleep();
+#endif /* HAS_SERIAL */
+	timer_sleep(ticks);
+#ifdef HAS_SERIAL
+	serial_wake();
+#endif /* HAS_SERIAL */
+	GIE = 1;
+}
+#endif /* HAS_SLEEP */
+
 static void interrupt isr (void)
 {
 	unsigned char temp;
@@ -262,7 +403,8 @@ static void interrupt isr (void)
 	/* (E)USART interrupts */
 	if (RCIF)
 		serial_rx_isr();
-	if (TXIF)
+	/* TXIF is set whenever TXREG is empty, also while there's nothing to send */
+	if (TXIE && TXIF)
 		serial_tx_isr();
 #endif
 }
\ No newline at end of file
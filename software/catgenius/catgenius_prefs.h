@@ -18,10 +18,18 @@
 #define HAS_COMMANDLINE_BOX					/* 1,020 words */
 #define HAS_COMMANDLINE_GPIO				/* 1,112 words */
 #define HAS_COMMANDLINE_EXTRA				/*   407 words */
+#define HAS_COMMANDLINE_MACRO
 #define HAS_COMMANDLINE_TAG					/* 1,766 words */
+#define HAS_FRAMING
 //#define HAS_COMMANDLINE_COMTESTS			/* 3,977 words */
 #define HAS_EVENTLOG						/*   331 words */
 //#define HAS_RTC							/*   259 words */
+#define HAS_TIMERQUEUE
+#define HAS_SLEEP
+#define HAS_EEPROMPROGRAM
+#define HAS_RFIDPROGRAM
+#define HAS_CARTRIDGE
+#define HAS_NVMJOURNAL
 #define HAS_DIAG
 
 // ------
@@ -32,9 +40,17 @@
 #	undef HAS_COMMANDLINE_BOX
 #	undef HAS_COMMANDLINE_GPIO
 #	undef HAS_COMMANDLINE_EXTRA
+#	undef HAS_COMMANDLINE_MACRO
 #	undef HAS_COMMANDLINE_TAG
 #	undef HAS_COMMANDLINE_COMTESTS
+#	undef HAS_FRAMING
 #	undef HAS_EVENTLOG
+#	undef HAS_TIMERQUEUE
+#	undef HAS_SLEEP
+#	undef HAS_EEPROMPROGRAM
+#	undef HAS_RFIDPROGRAM
+#	undef HAS_CARTRIDGE
+#	undef HAS_NVMJOURNAL
 #endif
 
 // ------
@@ -52,10 +68,13 @@
 // ------
 // DO NOT CHANGE -- Automatically include dependencies
 // ------
-#if (defined HAS_COMMANDLINE_BOX) || (defined HAS_COMMANDLINE_GPIO) || (defined HAS_COMMANDLINE_EXTRA) || (defined HAS_COMMANDLINE_TAG)
+#if (defined HAS_COMMANDLINE_BOX) || (defined HAS_COMMANDLINE_GPIO) || (defined HAS_COMMANDLINE_EXTRA) || (defined HAS_COMMANDLINE_TAG) || (defined HAS_COMMANDLINE_MACRO) || (defined HAS_FRAMING)
 #  define HAS_COMMANDLINE
 #endif
-#ifdef HAS_COMMANDLINE_TAG
+#ifdef HAS_RFIDPROGRAM
+#  define HAS_SRIX4K
+#endif
+#if (defined HAS_COMMANDLINE_TAG) || (defined HAS_SRIX4K)
 #  define HAS_CR14
 #endif
 #ifdef HAS_CR14
@@ -64,6 +83,9 @@
 #if (defined HAS_BLUETOOTH) || (defined HAS_COMMANDLINE) || (defined HAS_DEBUG)
 #  define HAS_SERIAL
 #endif
+#ifdef HAS_SLEEP
+#  define HAS_TIMERQUEUE
+#endif
 
 // Temporary hacks to get things working for testing
 //#define _CMM_TEMP_HACKS_
@@ -0,0 +1,225 @@
+/******************************************************************************/
+/* File    :	eepromwashprogram.c					      */
+/* Function:	CatGenius washing program stored in EEPROM		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+#include "../common/app_prefs.h"
+
+#ifdef HAS_EEPROMPROGRAM
+
+#include <htc.h>
+#include <stdio.h>
+#include <stdlib.h>				/* For atoi() */
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "litterlanguage.h"
+#include "eepromwashprogram.h"
+#include "../common/cmdline.h"
+#include "../common/serial.h"
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+#define INS_MAX			(NVM_PROGRAM_SIZE / INS_SIZE)
+
+/* Number of instructions read ahead on a cache miss */
+#define CACHE_SIZE		4
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+static unsigned int		ins_address	= 0;
+
+/* Read-ahead cache: cache_count instructions, starting at cache_address */
+static unsigned int		cache_address	= 0;
+static unsigned char		cache_count	= 0;
+static unsigned char		cache[CACHE_SIZE][INS_SIZE];
+
+/* Bytes queued for writing, one per pass by eepromwashprogram_work() */
+static unsigned char		write_data[EEPROM_WRITE_MAX];
+static unsigned char		write_offset;
+static unsigned char		write_index;
+static unsigned char		write_length	= 0;	/* 0 when done */
+
+
+/******************************************************************************/
+/* Local Prototypes							      */
+/******************************************************************************/
+
+static void		fill_cache		(unsigned int		address);
+#ifdef HAS_COMMANDLINE
+static signed char	hex2nibble		(char			hex);
+#endif
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+void eepromwashprogram_reqins (unsigned int address)
+{
+	ins_address = address;
+}
+
+unsigned char eepromwashprogram_getins (unsigned char * const ins)
+{
+	unsigned char	index;
+
+	if (ins_address >= INS_MAX) {
+		/* Running off the program area is an execution error */
+		ins[0] = INS_INVALID;
+		ins[1] = 0;
+		ins[2] = 0;
+		ins[3] = 0;
+		return 1;
+	}
+
+	if ( (ins_address < cache_address) ||
+	     (ins_address - cache_address >= cache_count) )
+		fill_cache(ins_address);
+	for (index = 0; index < INS_SIZE; index++)
+		ins[index] = cache[ins_address - cache_address][index];
+
+	return 1;
+}
+
+void eepromwashprogram_work (void)
+/******************************************************************************/
+/* Function:	eepromwashprogram_work					      */
+/*		- Writes the queued bytes to EEPROM one at a time, each once  */
+/*		  the previous one is done, so the main loop never waits      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	if (!write_length || WR)
+		return;
+
+	eeprom_write(NVM_PROGRAM + write_offset++, write_data[write_index++]);
+	/* Drop the cache, it may hold the old contents */
+	cache_count = 0;
+	if (write_index >= write_length)
+		write_length = 0;
+}
+/* eepromwashprogram_work */
+
+unsigned char eepromwashprogram_write (unsigned char offset,
+				       const unsigned char *data,
+				       unsigned char length)
+{
+	unsigned char	index;
+
+	/* Not under the program counter of a running program */
+	if (write_length || litterlanguage_running())
+		return 0;
+
+	for (index = 0; index < length; index++)
+		write_data[index] = data[index];
+	write_offset = offset;
+	write_index = 0;
+	write_length = length;
+	return 1;
+}
+
+unsigned char eepromwashprogram_busy (void)
+{
+	return (write_length != 0);
+}
+
+
+#ifdef HAS_COMMANDLINE
+int cmd_prog (int argc, char* argv[])
+{
+	unsigned char	offset;
+	unsigned char	index;
+
+	if (argc > 3) return ERR_SYNTAX;
+	if (argc == 2) {
+		if (!stricmp(argv[1], "rom"))
+			litterlanguage_set_source(SRC_ROM);
+		else if (!stricmp(argv[1], "ee"))
+			litterlanguage_set_source(SRC_EEPROM);
+#ifdef HAS_RFIDPROGRAM
+		else if (!stricmp(argv[1], "tag"))
+			litterlanguage_set_source(SRC_RFID);
+#endif
+		else
+			return ERR_PARAM;
+	}
+	if (argc == 3) {
+		/* Write hex bytes at a byte offset in the program area */
+		if ((atoi(argv[1]) < 0) || (atoi(argv[1]) >= NVM_PROGRAM_SIZE))
+			return ERR_PARAM;
+		offset = (unsigned char)atoi(argv[1]);
+		for (index = 0; argv[2][index]; index++)
+			if (hex2nibble(argv[2][index]) < 0)
+				return ERR_PARAM;
+		if ((index & 1) || (index / 2 > EEPROM_WRITE_MAX) ||
+		    (offset + index / 2 > NVM_PROGRAM_SIZE))
+			return ERR_PARAM;
+		/* The bytes replace their hex digits */
+		for (index = 0; argv[2][index]; index += 2)
+			argv[2][index / 2] = (char)((hex2nibble(argv[2][index]) << 4) |
+						    hex2nibble(argv[2][index+1]));
+		if (!eepromwashprogram_write(offset, (unsigned char *)argv[2],
+					     index / 2))
+			return ERR_IO;
+		TX2("Program: %u\n", offset + index / 2);
+		return ERR_OK;
+	}
+
+	switch (litterlanguage_get_source()) {
+	case SRC_EEPROM:
+		TX("Program: ee\n");
+		break;
+	case SRC_RFID:
+		TX("Program: tag\n");
+		break;
+	default:
+		TX("Program: rom\n");
+		break;
+	}
+
+	return ERR_OK;
+}
+#endif /* HAS_COMMANDLINE */
+
+
+/******************************************************************************/
+/* Local Implementations						      */
+/******************************************************************************/
+
+static void fill_cache (unsigned int address)
+{
+	unsigned char	nvm_address;
+	unsigned char	index;
+
+	cache_address = address;
+	nvm_address = NVM_PROGRAM + (unsigned char)address * INS_SIZE;
+	for (cache_count = 0;
+	     (cache_count < CACHE_SIZE) && (address + cache_count < INS_MAX);
+	     cache_count++)
+		for (index = 0; index < INS_SIZE; index++)
+			cache[cache_count][index] = eeprom_read(nvm_address++);
+}
+
+#ifdef HAS_COMMANDLINE
+static signed char hex2nibble (char hex)
+{
+	if ((hex >= '0') && (hex <= '9'))
+		return hex - '0';
+	if ((hex >= 'a') && (hex <= 'f'))
+		return hex - 'a' + 10;
+	if ((hex >= 'A') && (hex <= 'F'))
+		return hex - 'A' + 10;
+	return -1;
+}
+#endif /* HAS_COMMANDLINE */
+
+#endif /* HAS_EEPROMPROGRAM */
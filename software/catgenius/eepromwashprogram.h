@@ -0,0 +1,36 @@
+/******************************************************************************/
+/* File    :	eepromwashprogram.h					      */
+/* Function:	Header file of 'eepromwashprogram.c'.			      */
+/******************************************************************************/
+
+#ifndef EEPROMWASHPROGRAM_H		/* Include file already compiled? */
+#define EEPROMWASHPROGRAM_H
+
+#include "../common/app_prefs.h"
+
+#ifdef HAS_EEPROMPROGRAM
+
+/* Program addresses are instruction indices, the program starts at the first */
+#define EEPROM_WASHPROGRAM	0x0000
+
+/* Most bytes queued by a single write: a FRAME_PROG_WRITE less its offset */
+#define EEPROM_WRITE_MAX	31
+
+
+/* Control */
+void		eepromwashprogram_reqins (unsigned int			  address) ;
+unsigned char	eepromwashprogram_getins (unsigned char		   * const ins) ;
+void		eepromwashprogram_work	 (void) ;
+unsigned char	eepromwashprogram_write	 (unsigned char			  offset,
+					  const unsigned char		 *data,
+					  unsigned char			  length) ;
+unsigned char	eepromwashprogram_busy	 (void) ;
+
+#ifdef HAS_COMMANDLINE
+/* Command line */
+int		cmd_prog		 (int argc, char* argv[]) ;
+#endif
+
+#endif /* HAS_EEPROMPROGRAM */
+
+#endif /* EEPROMWASHPROGRAM_H */
@@ -15,12 +15,17 @@
 #define LITTERLANGUAGE_C
 #include "litterlanguage.h"
 #include "romwashprogram.h"
+#include "eepromwashprogram.h"
+#include "rfidwashprogram.h"
+#include "cartridge.h"
 #include "../common/timer.h"
 #include "../common/water.h"
 #include "../common/rtc.h"
 #include "userinterface.h"
 #include "../common/eventlog.h"
+#include "../common/nvm.h"
 #include "../common/types.h"
+#include "../common/frame.h"
 
 extern void litterlanguage_event (unsigned char event, unsigned char argument);
 
@@ -40,11 +45,24 @@ extern void litterlanguage_event (unsigned char event, unsigned char argument);
 #define STATE_GET_INS		4
 #define STATE_WAIT_INS		5
 
+#define LOOP_DEPTH		2	/* Number of loops that can be nested */
+#define CALL_DEPTH		4	/* Number of sub-routine calls that can be nested */
+#define INS_BUDGET		8	/* Instructions executed back-to-back in one pass */
+
+/******************************************************************************/
+/* Types								      */
+/******************************************************************************/
+
+struct loop {
+	unsigned int	address;	/* First instruction of the loop body */
+	unsigned char	count;		/* Iterations left */
+};
+
 /******************************************************************************/
 /* Global Data								      */
 /******************************************************************************/
 
-static unsigned char		prg_source		= 0;
+static unsigned char		prg_source		= SRC_ROM;	/* Source of the washing program */
 #ifndef CMM_ARM_EXPERIMENT
 static unsigned char		arm_position		= 0;
 #endif
@@ -57,8 +75,14 @@ static bit			error_execution		= 0;
 
 /* Program execution variables */
 static unsigned char		ins_state		= STATE_IDLE;
-static struct instruction	const * ins_pointer	= 0;
+static unsigned char		ins_source		= SRC_ROM;	/* Source of the running program */
+static unsigned int		ins_base		= 0;	/* Medium address of the running program image */
+static unsigned int		pc			= 0;	/* Instruction offset into the image */
 static struct instruction	cur_instruction;
+static struct loop		loops[LOOP_DEPTH];
+static unsigned char		loop_depth		= 0;
+static unsigned int		ret_addresses[CALL_DEPTH];
+static unsigned char		call_depth		= 0;
 
 static struct timer		timer_waitins		= NEVER;
 static struct timer		timer_fill		= NEVER;
@@ -72,7 +96,7 @@ static struct timer		timer_autoarm		= NEVER;
 /******************************************************************************/
 
 static void		litterlanguage_cleanup	(unsigned char		wet);
-static void		req_instruction		(struct instruction	const *instruction);
+static void		req_instruction		(unsigned int		address);
 static unsigned char	get_instruction		(struct instruction	*instruction);
 static void		exe_instruction		(void);
 static void		wait_instruction	(void);
@@ -92,9 +116,19 @@ void litterlanguage_init (unsigned char flags)
 {
 	static const char *_s_box_is = "Box is ";
 
+	/* Queue the timers */
+	timer_register(&timer_waitins, TIMER_OWNER_LITTERLANGUAGE);
+	timer_register(&timer_fill, TIMER_OWNER_LITTERLANGUAGE);
+	timer_register(&timer_drain, TIMER_OWNER_LITTERLANGUAGE);
+	timer_register(&timer_autodose, TIMER_OWNER_LITTERLANGUAGE);
+	timer_register(&timer_autoarm, TIMER_OWNER_LITTERLANGUAGE);
+
+	/* Restore the program source */
+	litterlanguage_set_source(nvm_read(NVM_PRGSOURCE));
+
 	switch(flags & BUTTONS) {
 		case 0:
-			switch (eeprom_read(NVM_BOXSTATE)){
+			switch (nvm_read(NVM_BOXSTATE)){
 			case BOX_TIDY:
 				DBG2("%s tidy\n", _s_box_is);
 				break;
@@ -108,7 +142,7 @@ void litterlanguage_init (unsigned char flags)
 				break;
 			default:
 				DBG2("%s unknown\n", _s_box_is);
-				eeprom_write(NVM_BOXSTATE, BOX_TIDY);
+				nvm_write(NVM_BOXSTATE, BOX_TIDY);
 				break;
 			}
 			break;
@@ -123,7 +157,7 @@ void litterlanguage_init (unsigned char flags)
 		case START_BUTTON | SETUP_BUTTON:
 		default:
 			/* User wants to reset box state */
-			eeprom_write(NVM_BOXSTATE, BOX_TIDY);
+			nvm_write(NVM_BOXSTATE, BOX_TIDY);
 			break;
 	}
 }
@@ -138,15 +172,22 @@ void litterlanguage_work (void)
 /*		- Initial revision.					      */
 /******************************************************************************/
 {
+	unsigned char	due;
+	unsigned char	budget;
+
 	/* Don't work if paused */
 	if (paused)
 		return;
 
+	/* Timeouts are only checked if any of them expired */
+	due = timer_due(TIMER_OWNER_LITTERLANGUAGE);
+
 	/* Check if a program is executed */
 	if (ins_state != STATE_IDLE) {
 		/* Check for filling timeout */
 		if( !water_detected() &&
 		    water_filling() &&
+		    due &&
 		    timeoutexpired(&timer_fill) ){
 			printtime();
 			DBG("Fill timeout\n");
@@ -158,6 +199,7 @@ void litterlanguage_work (void)
 		/* Check for draining timeout */
 		if( water_detected() &&
 		    get_Pump() &&
+		    due &&
 		    timeoutexpired(&timer_drain) ){
 			printtime();
 			DBG("Drain timeout\n");
@@ -166,7 +208,8 @@ void litterlanguage_work (void)
 			litterlanguage_event(EVENT_ERR_DRAINING, error_drain);
 		}
 		/* Check auto-dose timeout */
-		if (timeoutexpired(&timer_autodose)) {
+		if (due &&
+		    timeoutexpired(&timer_autodose)) {
 			timeoutnever(&timer_autodose);
 			set_Dosage(0);
 		}
@@ -175,7 +218,8 @@ void litterlanguage_work (void)
 		// Always check arm timeout, even if a prog is not running
 #endif
 		/* Check arm timeout */
-		if (timeoutexpired(&timer_autoarm)) {
+		if (due &&
+		    timeoutexpired(&timer_autoarm)) {
 			timeoutnever(&timer_autoarm);
 			set_Arm(ARM_STOP);
 		}
@@ -191,22 +235,24 @@ void litterlanguage_work (void)
 	case STATE_FETCH_START:	/* Fetch the start instruction */
 		error_execution = 0;
 		litterlanguage_event(EVENT_ERR_EXECUTION, error_execution);
-		req_instruction(ins_pointer);
+		loop_depth = 0;
+		call_depth = 0;
+		req_instruction(ins_base + pc);
 		ins_state = STATE_GET_START;
 		/* no break; */
 
 	case STATE_GET_START:	/* Wait for the start instruction to be fetched */
 		if (get_instruction(&cur_instruction)) {
-//			DBG("IP 0x%04X: ", ins_pointer);
+//			DBG("IP 0x%04X: ", pc);
 			if (cur_instruction.opcode == INS_START) {
 //				DBG("INS_START, %s", wet_program?"wet":"dry");
 				/* Check if this is a valid program for us */
-				if( ((cur_instruction.operant & 0x00FF) <= INS_END) &&
+				if( ((cur_instruction.operant & 0x00FF) <= INS_LAST) &&
 				    ( (!wet_program && (cur_instruction.operant & FLAGS_DRYRUN)) ||
 				      (wet_program && (cur_instruction.operant & FLAGS_WETRUN)) ) ) {
-					if (eeprom_read(NVM_BOXSTATE) < BOX_MESSY)
-						eeprom_write(NVM_BOXSTATE, BOX_MESSY);
-					ins_pointer++;
+					if (nvm_read(NVM_BOXSTATE) < BOX_MESSY)
+						nvm_write(NVM_BOXSTATE, BOX_MESSY);
+					pc++;
 					ins_state = STATE_FETCH_INS;
 				} else {
 					ins_state = STATE_IDLE;
@@ -221,14 +267,23 @@ void litterlanguage_work (void)
 		break;
 
 	case STATE_FETCH_INS:	/* Fetch the next instruction */
-		req_instruction(ins_pointer);
-		ins_state = STATE_GET_INS;
-		/* no break; */
-
-	case STATE_GET_INS:	/* Wait for the start instruction to be fetched */
-		if (get_instruction(&cur_instruction)) {
+	case STATE_GET_INS:	/* Wait for the instruction to be fetched */
+		/* Instructions that take no time are executed back-to-back, so
+		   actuators the program switches together switch in the same
+		   pass. The budget bounds the time spent here. */
+		for (budget = INS_BUDGET; budget; budget--) {
+			if (ins_state == STATE_FETCH_INS) {
+				req_instruction(ins_base + pc);
+				ins_state = STATE_GET_INS;
+			}
+			if (!get_instruction(&cur_instruction))
+				/* Medium still busy */
+				break;
 			/* Decode and execute the instruction */
 			exe_instruction();
+			if ((ins_state != STATE_FETCH_INS) || paused)
+				/* Waiting, finished or failed */
+				break;
 		}
 		break;
 
@@ -240,17 +295,74 @@ void litterlanguage_work (void)
 /* litterlanguage_work */
 
 
+void litterlanguage_set_source (unsigned char source)
+{
+	switch (source) {
+#ifdef HAS_EEPROMPROGRAM
+	case SRC_EEPROM:
+#endif
+#ifdef HAS_RFIDPROGRAM
+	case SRC_RFID:
+#endif
+	case SRC_ROM:
+		break;
+	default:
+		/* Fall back on the program that's always there */
+		source = SRC_ROM;
+		break;
+	}
+	prg_source = source;
+	if (nvm_read(NVM_PRGSOURCE) != source)
+		nvm_write(NVM_PRGSOURCE, source);
+}
+
+
+unsigned char litterlanguage_get_source (void)
+{
+	return (prg_source);
+}
+
+
 void litterlanguage_start (unsigned char wet)
 {
-	extern const struct instruction	washprogram[];
 	if (ins_state == STATE_IDLE) {
+#ifdef HAS_EEPROMPROGRAM
+		/* Don't run a program that's half written */
+		if ((prg_source == SRC_EEPROM) && eepromwashprogram_busy()) {
+			DBG("Program being written\n");
+			return;
+		}
+#endif
+#if (defined HAS_RFIDPROGRAM) && (defined HAS_FRAMING)
+		/* The tag reader is shared with FRAME_TAG_READ */
+		if ((prg_source == SRC_RFID) && frame_busy()) {
+			DBG("Tag reader busy\n");
+			return;
+		}
+#endif
 		printtime();
 		DBG2("Starting %s program\n", wet?"wet":"dry");
 		switch (prg_source) {
+#ifdef HAS_EEPROMPROGRAM
+		case SRC_EEPROM:
+			ins_base = EEPROM_WASHPROGRAM;
+			pc = 0;
+			break;
+#endif
+#ifdef HAS_RFIDPROGRAM
+		case SRC_RFID:
+			rfidwashprogram_flush();
+			ins_base = RFID_WASHPROGRAM;
+			pc = 0;
+			break;
+#endif
 		case SRC_ROM:
-			ins_pointer = &washprogram[0];
+			/* All ROM tables form a single image */
+			ins_base = 0;
+			pc = rom_washprogram;
 			break;
 		}
+		ins_source = prg_source;
 		wet_program = wet;
 		ins_state = STATE_FETCH_START ;
 	}
@@ -391,6 +503,11 @@ void litterlanguage_stop (void)
 	}
 	error_flood = 0;
 
+#ifdef HAS_CARTRIDGE
+	/* Store what the program dispensed */
+	cartridge_commit();
+#endif /* HAS_CARTRIDGE */
+
 	eventlog_track(EVENTLOG_LL_ADDR, 0);
 }
 
@@ -485,33 +602,67 @@ void heatsensor_event (unsigned char detected)
 
 static void litterlanguage_cleanup (unsigned char wet)
 {
-	extern const struct instruction	cleanupprogram[];
 	if (ins_state == STATE_IDLE) {
 		printtime();
 		DBG2("Starting %s cleanup\n", wet?"wet":"dry");
-		prg_source = SRC_ROM;
-		ins_pointer = &cleanupprogram[0];
+		ins_source = SRC_ROM;
+		ins_base = 0;
+		pc = rom_cleanupprogram;
 		wet_program = wet;
 		ins_state = STATE_FETCH_START ;
 	}
 }
 
 
-static void req_instruction (struct instruction const *instruction)
+static void req_instruction (unsigned int address)
 {
-	switch (prg_source) {
+	switch (ins_source) {
+#ifdef HAS_EEPROMPROGRAM
+	case SRC_EEPROM:
+		eepromwashprogram_reqins(address);
+		break;
+#endif
+#ifdef HAS_RFIDPROGRAM
+	case SRC_RFID:
+		rfidwashprogram_reqins(address);
+		break;
+#endif
 	case SRC_ROM:
-		romwashprogram_reqins(instruction);
+		romwashprogram_reqins(address);
+		break;
 	}
 }
 
 static unsigned char get_instruction (struct instruction *instruction)
 {
-	switch (prg_source) {
+	unsigned char	ins[INS_SIZE];
+	unsigned char	fetched;
+
+	switch (ins_source) {
+#ifdef HAS_EEPROMPROGRAM
+	case SRC_EEPROM:
+		fetched = eepromwashprogram_getins(ins);
+		break;
+#endif
+#ifdef HAS_RFIDPROGRAM
+	case SRC_RFID:
+		fetched = rfidwashprogram_getins(ins);
+		break;
+#endif
 	default:
 	case SRC_ROM:
-		return romwashprogram_getins(instruction);
+		fetched = romwashprogram_getins(ins);
+		break;
 	}
+	if (!fetched)
+		return 0;
+
+	/* Decode the record, it's the same on all media */
+	instruction->opcode = ins[0];
+	instruction->operant = ((unsigned long)ins[1] << 16) |
+			       ((unsigned int)ins[2] << 8) |
+			       ins[3];
+	return 1;
 }
 
 #ifdef CMM_ARM_EXPERIMENT
@@ -568,38 +719,20 @@ void ins_Arm (unsigned char target)
 
 static void exe_instruction (void)
 {
-	static struct instruction	const * ret_address;
-	unsigned int			temp;
-
-	// TBD: CMM - This is a bit of a hack until we get a Program Counter implemented
-	_U16 pc;
-	/*
-	extern const struct instruction	washprogram[];
-	extern const struct instruction	cleanupprogram[];
-	if (&washprogram[0] < &cleanupprogram[0])
-	{
-		pc = (_U16)(ins_pointer >= &cleanupprogram[0]) ? (&cleanupprogram[0] - ins_pointer) : (&washprogram[0] - ins_pointer);
-	}
-	else
-	{
-		pc = (_U16)(ins_pointer < &washprogram[0]) ? (&cleanupprogram[0] - ins_pointer) : (&washprogram[0] - ins_pointer);
-	}
-	*/
-	pc = (_U16)ins_pointer;
 	eventlog_track(EVENTLOG_LL_ADDR, pc);
 
 //	printtime();
-//	DBG("IP 0x%04X: ", ins_pointer);
+//	DBG("IP 0x%04X: ", pc);
 	switch (cur_instruction.opcode) {
 	case INS_BOWL:
 //		DBG("INS_BOWL, %s", (cur_instruction.operant == BOWL_STOP)?"BOWL_STOP":((cur_instruction.operant == BOWL_CW)?"BOWL_CW":"BOWL_CCW"));
 		set_Bowl((unsigned char)cur_instruction.operant);
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_ARM:
 #ifdef CMM_ARM_EXPERIMENT
-		ins_Arm(cur_instruction.operant);
+		ins_Arm((unsigned char)cur_instruction.operant);
 #else
 //		DBG("INS_ARM, %s", (cur_instruction.operant == ARM_STOP)?"ARM_STOP":((cur_instruction.operant == ARM_DOWN)?"ARM_DOWN":"ARM_UP"));
 		switch (cur_instruction.operant) {
@@ -637,15 +770,15 @@ static void exe_instruction (void)
 			break;
 		}
 #endif
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_WATER:
 //		DBG("INS_WATER, %s%s", cur_instruction.operant?"on":"off", wet_program?"":" (nop)");
 		if (wet_program)
 			if (cur_instruction.operant) {
-				if (eeprom_read(NVM_BOXSTATE) < BOX_WET)
-					eeprom_write(NVM_BOXSTATE, BOX_WET);
+				if (nvm_read(NVM_BOXSTATE) < BOX_WET)
+					nvm_write(NVM_BOXSTATE, BOX_WET);
 				/* Don't fill if water is detected already */
 				if (!water_detected()) {
 					printtime();
@@ -660,7 +793,7 @@ static void exe_instruction (void)
 				water_fill(0);
 				timeoutnever(&timer_fill);
 			}
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_PUMP:
@@ -670,20 +803,20 @@ static void exe_instruction (void)
 			DBG("Draining\n");
 			set_Pump((unsigned char)cur_instruction.operant);
 		}
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_DRYER:
 //		DBG("INS_DRYER, %s%s", cur_instruction.operant?"on":"off", wet_program?"":" (nop)");
 		if (wet_program)
 			set_Dryer((unsigned char)cur_instruction.operant);
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_WAITTIME:
-//		DBG("INS_WAITTIME, %ums", cur_instruction.operant);
-		settimeout( &timer_waitins,
-			    (unsigned long)cur_instruction.operant * MILISECOND );
+//		DBG("INS_WAITTIME, %lu ticks", cur_instruction.operant);
+		/* The argument already is in timer ticks */
+		settimeout(&timer_waitins, cur_instruction.operant);
 		ins_state = STATE_WAIT_INS;
 		break;
 	case INS_WAITWATER:
@@ -694,7 +827,7 @@ static void exe_instruction (void)
 				settimeout(&timer_drain, MAX_DRAINTIME);
 			ins_state = STATE_WAIT_INS;
 		} else {
-			ins_pointer++;
+			pc++;
 			ins_state = STATE_FETCH_INS;
 		}
 		break;
@@ -703,24 +836,24 @@ static void exe_instruction (void)
 		if (wet_program)
 			ins_state = STATE_WAIT_INS;
 		else {
-			ins_pointer++;
+			pc++;
 			ins_state = STATE_FETCH_INS;
 		}
 		break;
 	case INS_SKIPIFDRY:
 //		DBG("INS_SKIPIFDRY, %u%s", cur_instruction.operant, wet_program?" (nop)":"");
 		if (!wet_program)
-			ins_pointer += cur_instruction.operant + 1;
+			pc += (unsigned int)cur_instruction.operant + 1;
 		else
-			ins_pointer++;
+			pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_SKIPIFWET:
 //		DBG("INS_SKIPIFWET, %u%s", cur_instruction.operant, wet_program?"":" (nop)");
 		if (wet_program)
-			ins_pointer += cur_instruction.operant + 1;
+			pc += (unsigned int)cur_instruction.operant + 1;
 		else
-			ins_pointer++;
+			pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_AUTODOSE:
@@ -729,27 +862,72 @@ static void exe_instruction (void)
 			settimeout(&timer_autodose,
 				   (unsigned long)cur_instruction.operant * SECOND * (DOSAGE_SECONDS_PER_ML / 10));
 			set_Dosage(1);
+#ifdef HAS_CARTRIDGE
+			cartridge_dose((unsigned int)cur_instruction.operant);
+#endif /* HAS_CARTRIDGE */
 		}
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_CALL:
 //		DBG("INS_CALL, 0x%04X", cur_instruction.operant);
-		ret_address = ins_pointer + 1;
-		/* DIRTY HACK: Set highest bit, which seems to get lost due to compiler limitation */
-		temp = 0x8000 | cur_instruction.operant;
-		/* HACK: memcpy instead of casting to work around compiler limitation */
-		memcpy(&ins_pointer, &temp, sizeof(ins_pointer));
+		if (call_depth >= CALL_DEPTH) {
+			/* Nested too deep */
+			error_execution = 1;
+			litterlanguage_event(EVENT_ERR_EXECUTION, error_execution);
+			break;
+		}
+		ret_addresses[call_depth++] = pc + 1;
+		/* The argument is an offset into the same program image */
+		pc = (unsigned int)cur_instruction.operant;
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_RETURN:
-//		DBG("INS_RETURN, 0x%04X", ret_address);
-		ins_pointer = ret_address;
+		if (call_depth == 0) {
+			/* Not in a sub-routine */
+			error_execution = 1;
+			litterlanguage_event(EVENT_ERR_EXECUTION, error_execution);
+			break;
+		}
+		pc = ret_addresses[--call_depth];
+//		DBG("INS_RETURN, 0x%04X", pc);
+		ins_state = STATE_FETCH_INS;
+		break;
+	case INS_LOOP:
+//		DBG("INS_LOOP, %u", cur_instruction.operant);
+		if ( (loop_depth >= LOOP_DEPTH) ||
+		     (cur_instruction.operant == 0) ||
+		     (cur_instruction.operant > 0xFF) ) {
+			/* Nested too deep or nothing to count */
+			error_execution = 1;
+			litterlanguage_event(EVENT_ERR_EXECUTION, error_execution);
+			break;
+		}
+		pc++;
+		loops[loop_depth].address = pc;
+		loops[loop_depth].count = (unsigned char)cur_instruction.operant;
+		loop_depth++;
+		ins_state = STATE_FETCH_INS;
+		break;
+	case INS_REPEAT:
+//		DBG("INS_REPEAT");
+		if (loop_depth == 0) {
+			/* Not in a loop */
+			error_execution = 1;
+			litterlanguage_event(EVENT_ERR_EXECUTION, error_execution);
+			break;
+		}
+		if (--loops[loop_depth - 1].count) {
+			pc = loops[loop_depth - 1].address;
+		} else {
+			loop_depth--;
+			pc++;
+		}
 		ins_state = STATE_FETCH_INS;
 		break;
 	case INS_END:
 //		DBG("INS_END\n");
-		eeprom_write(NVM_BOXSTATE, BOX_TIDY);
+		nvm_write(NVM_BOXSTATE, BOX_TIDY);
 		litterlanguage_stop();
 		break;
 	case INS_START:
@@ -771,34 +949,35 @@ static void wait_instruction (void)
 {
 	switch (cur_instruction.opcode) {
 	case INS_WAITTIME:
-		if (timeoutexpired(&timer_waitins)) {
-			ins_pointer++;
+		if (timer_due(TIMER_OWNER_LITTERLANGUAGE) &&
+		    timeoutexpired(&timer_waitins)) {
+			pc++;
 			ins_state = STATE_FETCH_INS;
 		}
 		break;
 	case INS_WAITWATER:
 		if (cur_instruction.operant) {
 			if (water_detected()) {
-				ins_pointer++;
+				pc++;
 				ins_state = STATE_FETCH_INS;
 			}
 		} else {
 			if (!water_detected()) {
 				/* Disable the timeout */
 				timeoutnever(&timer_drain);
-				ins_pointer++;
+				pc++;
 				ins_state = STATE_FETCH_INS;
 			}
 		}
 		break;
 	case INS_WAITDOSAGE:
 		if (!get_Dosage()) {
-			ins_pointer++;
+			pc++;
 			ins_state = STATE_FETCH_INS;
 		}
 		break;
 	default:
-		ins_pointer++;
+		pc++;
 		ins_state = STATE_FETCH_INS;
 		break;
 	}
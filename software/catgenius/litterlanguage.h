@@ -32,14 +32,33 @@
 #define INS_PUMP		0x04	/* Controls the hopper pump. Argument is 1 for on, 0 for off */
 #define INS_DRYER		0x05	/* Controls the dryer fan. Argument is 1 for on, 0 for off */
 #define INS_AUTODOSE		0x06	/* Controls the dosage pump. Argument x100 is amount in microliters */
-#define INS_WAITTIME		0x07	/* Waits a period of time. Argument is period in milliseconds */
+#define INS_WAITTIME		0x07	/* Waits a period of time. Argument is period in timer ticks, see MS() */
 #define INS_WAITWATER		0x08	/* Waits for a water sensor state. Argument is state: 1 for high, 0 for low */
 #define INS_WAITDOSAGE		0x09	/* Waits for autodosage to complete. Argument is ignored */
 #define INS_SKIPIFDRY		0x0A	/* Skips argument instructions if the program runs in dry mode */
 #define INS_SKIPIFWET		0x0B	/* Skips argument instructions if the program runs in wet mode */
-#define INS_CALL		0x0C	/* Call a subroutine. Argument is the address on the program medium */
+#define INS_CALL		0x0C	/* Call a subroutine. Argument is the sub-routine offset into the program image */
 #define INS_RETURN		0x0D	/* Return from all a subroutine. Argument is ignored */
 #define INS_END			0x0E
+#define INS_LOOP		0x0F	/* Starts a loop. Argument is the number of iterations, 1 to 255 */
+#define INS_REPEAT		0x10	/* Ends a loop. Jumps back to the first instruction after INS_LOOP until all iterations are done */
+#define INS_LAST		0x10	/* Highest opcode this interpreter knows, programs using more are refused */
+#define INS_INVALID		0xFF	/* Never a valid opcode. Program media return it for addresses they can't provide */
+
+/* Program records on all media: opcode, then a 24 bit operant MSB first.
+ * The ROM programs take 956 retlw words this way, against 756 for the 252
+ * 3 byte records they were before the long waits were merged. That buys
+ * waits in timer ticks without a run time multiply, and a single record
+ * format for ROM, EEPROM, tag and llc images */
+#define INS_SIZE		4
+#define INS_OPERANT_MAX		0xFFFFFFUL
+#define INS(opcode, operant)	INS_##opcode, (unsigned char)(((unsigned long)(operant) >> 16) + INS_CHECK(operant)), (unsigned char)((unsigned long)(operant) >> 8), (unsigned char)(operant)
+
+/* Fails to compile for an operant that doesn't fit, like a period over 134s */
+#define INS_CHECK(operant)	(0 * sizeof(char[((unsigned long)(operant) <= INS_OPERANT_MAX) ? 1 : -1]))
+
+/* INS_WAITTIME argument for a period in milliseconds, converted at compile time */
+#define MS(ms)			((unsigned long)(ms) * MILISECOND)
 
 #define	INS_ARM__STOP		255	/* INS_ARM argument to make the arm stop */
 #define	INS_ARM__DOWN		254	/* INS_ARM argument to make the arm move down indefinetely */
@@ -51,7 +70,7 @@
 /* Types */
 struct instruction {
 	unsigned char	opcode;
-	unsigned int	operant;
+	unsigned long	operant;
 };
 
 /* Generic */
@@ -59,6 +78,8 @@ void		litterlanguage_init	(unsigned char	flags) ;
 void		litterlanguage_work	(void) ;
 
 /* Control */
+void		litterlanguage_set_source(unsigned char	source) ;
+unsigned char	litterlanguage_get_source(void) ;
 void		litterlanguage_start	(unsigned char	wet) ;
 unsigned char	litterlanguage_running	(void) ;
 void		litterlanguage_pause	(unsigned char	pause) ;
@@ -0,0 +1,201 @@
+/******************************************************************************/
+/* File    :	rfidwashprogram.c					      */
+/* Function:	CatGenius washing program stored on the cartridge tag	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+#include "../common/app_prefs.h"
+
+#ifdef HAS_RFIDPROGRAM
+
+#include <htc.h>
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "litterlanguage.h"
+#include "rfidwashprogram.h"
+#include "../common/srix4k.h"
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+/* The program occupies the upper user blocks of the SRIX4K */
+#define TAG_PROGRAM_BLOCK	0x20
+#define TAG_PROGRAM_BLOCKS	0x60
+
+#define INS_MAX			((TAG_PROGRAM_BLOCKS * SRIX4K_BLOCKSIZE) / INS_SIZE)
+
+/* Number of blocks kept, starting at the one of the current instruction */
+#define CACHE_BLOCKS		3
+#define NO_BLOCK		0xFF
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+static unsigned int		ins_address	= 0;
+static bit			active		= 0;
+static bit			failed		= 0;
+static unsigned char		pending		= NO_BLOCK;
+
+/* Block cache: program block numbers and their contents */
+static unsigned char		cache_nr[CACHE_BLOCKS] = {NO_BLOCK, NO_BLOCK, NO_BLOCK};
+static unsigned char		cache[CACHE_BLOCKS][SRIX4K_BLOCKSIZE];
+
+
+/******************************************************************************/
+/* Local Prototypes							      */
+/******************************************************************************/
+
+static unsigned char	lookup			(unsigned char		nr);
+static unsigned char	first_block		(void);
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+void rfidwashprogram_work (void)
+/******************************************************************************/
+/* Function:	rfidwashprogram_work					      */
+/*		- Collects blocks read from the tag and requests the next     */
+/*		  missing one, so they are in while the program waits	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	data[SRIX4K_BLOCKSIZE];
+	unsigned char	first;
+	unsigned char	nr;
+	unsigned char	slot;
+	unsigned char	index;
+
+	first = first_block();
+
+	if (pending != NO_BLOCK) {
+		switch (srix4k_status()) {
+		case SRIX4K_BUSY:
+			return;
+		case SRIX4K_OK:
+			nr = srix4k_data(data) - TAG_PROGRAM_BLOCK;
+			/* Blocks left behind by a jump are dropped */
+			if ((nr < first) || (nr - first >= CACHE_BLOCKS))
+				break;
+			/* Replace a block that fell out of the window */
+			for (slot = 0; slot < CACHE_BLOCKS; slot++)
+				if ( (cache_nr[slot] == NO_BLOCK) ||
+				     (cache_nr[slot] < first) ||
+				     (cache_nr[slot] - first >= CACHE_BLOCKS) )
+					break;
+			for (index = 0; index < SRIX4K_BLOCKSIZE; index++)
+				cache[slot][index] = data[index];
+			cache_nr[slot] = nr;
+			break;
+		case SRIX4K_IDLE:
+			/* The block went to FRAME_TAG_READ, ask again below */
+			break;
+		default:
+			failed = 1;
+			break;
+		}
+		pending = NO_BLOCK;
+	}
+
+	if (!active || failed)
+		return;
+
+	/* Request the first block missing in the window */
+	for (nr = first;
+	     (nr - first < CACHE_BLOCKS) && (nr < TAG_PROGRAM_BLOCKS);
+	     nr++)
+		if (lookup(nr) >= CACHE_BLOCKS) {
+			if (srix4k_read(TAG_PROGRAM_BLOCK + nr))
+				pending = nr;
+			break;
+		}
+}
+/* rfidwashprogram_work */
+
+
+void rfidwashprogram_flush (void)
+{
+	unsigned char	slot;
+
+	/* The cartridge may have been swapped since the last run */
+	for (slot = 0; slot < CACHE_BLOCKS; slot++)
+		cache_nr[slot] = NO_BLOCK;
+	active = 1;
+	failed = 0;
+}
+
+void rfidwashprogram_reqins (unsigned int address)
+{
+	ins_address = address;
+}
+
+unsigned char rfidwashprogram_getins (unsigned char * const ins)
+{
+	unsigned int	offset;
+	unsigned char	index;
+	unsigned char	slot;
+
+	if (ins_address >= INS_MAX) {
+		/* Running off the program area is an execution error */
+		ins[0] = INS_INVALID;
+		ins[1] = 0;
+		ins[2] = 0;
+		ins[3] = 0;
+		return 1;
+	}
+
+	offset = ins_address * INS_SIZE;
+	for (index = 0; index < INS_SIZE; index++, offset++) {
+		slot = lookup((unsigned char)(offset / SRIX4K_BLOCKSIZE));
+		if (slot >= CACHE_BLOCKS) {
+			if (!failed)
+				/* Still being read */
+				return 0;
+			/* Unreadable tag is an execution error */
+			ins[0] = INS_INVALID;
+			ins[1] = 0;
+			ins[2] = 0;
+			ins[3] = 0;
+			return 1;
+		}
+		ins[index] = cache[slot][offset % SRIX4K_BLOCKSIZE];
+	}
+
+	return 1;
+}
+
+unsigned char rfidwashprogram_busy (void)
+{
+	return (pending != NO_BLOCK);
+}
+
+
+/******************************************************************************/
+/* Local Implementations						      */
+/******************************************************************************/
+
+static unsigned char lookup (unsigned char nr)
+{
+	unsigned char	slot;
+
+	for (slot = 0; slot < CACHE_BLOCKS; slot++)
+		if (cache_nr[slot] == nr)
+			break;
+	return slot;
+}
+
+static unsigned char first_block (void)
+{
+	if (ins_address >= INS_MAX)
+		return TAG_PROGRAM_BLOCKS;
+	return (unsigned char)((ins_address * INS_SIZE) / SRIX4K_BLOCKSIZE);
+}
+
+#endif /* HAS_RFIDPROGRAM */
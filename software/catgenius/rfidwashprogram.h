@@ -0,0 +1,28 @@
+/******************************************************************************/
+/* File    :	rfidwashprogram.h					      */
+/* Function:	Header file of 'rfidwashprogram.c'.			      */
+/******************************************************************************/
+
+#ifndef RFIDWASHPROGRAM_H		/* Include file already compiled? */
+#define RFIDWASHPROGRAM_H
+
+#include "../common/app_prefs.h"
+
+#ifdef HAS_RFIDPROGRAM
+
+/* Program addresses are instruction indices, the program starts at the first */
+#define RFID_WASHPROGRAM	0x0000
+
+
+/* Generic */
+void		rfidwashprogram_work	(void) ;
+
+/* Control */
+void		rfidwashprogram_flush	(void) ;
+void		rfidwashprogram_reqins	(unsigned int			  address) ;
+unsigned char	rfidwashprogram_getins	(unsigned char		  * const ins) ;
+unsigned char	rfidwashprogram_busy	(void) ;
+
+#endif /* HAS_RFIDPROGRAM */
+
+#endif /* RFIDWASHPROGRAM_H */
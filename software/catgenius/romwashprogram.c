@@ -10,8 +10,9 @@
 
 #include "../common/hardware.h"		/* Flexible hardware configuration */
 
-#include "romwashprogram.h"
 #include "litterlanguage.h"
+#include "romwashprogram.h"
+#include "../common/timer.h"
 
 
 /******************************************************************************/
@@ -21,319 +22,341 @@
 //#define TEST_NOPROGRAM
 //#define TEST_ARM
 
+/*
+ * The ROM image is all tables back to back, in source order, like llc links
+ * them. Program addresses are instruction indices into it, so a table can
+ * only call the ones before it.
+ */
+#define SIZE(table)		(sizeof(table) / INS_SIZE)
+
+#define ROM_SCOOP		0
+#define ROM_DRAIN		(ROM_SCOOP + SIZE(scoop))
+#define ROM_DRAIN_DRY		(ROM_DRAIN + SIZE(drain))
+#define ROM_SURFACE		(ROM_DRAIN_DRY + SIZE(drain_dry))
+#define ROM_CLEANUPPROGRAM	(ROM_SURFACE + SIZE(surface))
+#define ROM_WASHPROGRAM		(ROM_CLEANUPPROGRAM + SIZE(cleanupprogram))
+
 
 /******************************************************************************/
 /* Global Data								      */
 /******************************************************************************/
 
-static struct instruction		const * ins_address = 0;
+static unsigned int			ins_address = 0;
 
 /*
  * Sub-routines
  */
-const struct instruction	drain[] = {
-	{INS_PUMP,	1},		/* Wash + 15 */
-	{INS_WAITTIME,	25206},
-	{INS_PUMP,	0},		/* Wash + 16 */
-	{INS_WAITTIME,	65535},		/* Delay split in two because it exceeds maximum */
-	{INS_WAITTIME,	10183},		/* 65535 + 10183 = 75718 */
-	{INS_PUMP,	1},		/* Wash + 17 */
-	{INS_WAITTIME,	24206},
-	{INS_PUMP,	0},		/* Wash + 18 */
-	{INS_WAITTIME,	8202},
-	{INS_PUMP,	1},		/* Wash + 19 */
-	{INS_WAITTIME,	24206},
-	{INS_PUMP,	0},		/* Wash + 20 */
-	{INS_WAITTIME,	8202},
-	{INS_PUMP,	1},		/* Wash + 21 */
-	{INS_WAITTIME,	65535},		/* Delay split in two because it exceeds maximum */
-	{INS_WAITTIME,	10183},		/* 65535 + 10183 = 75718 */
-	{INS_PUMP,	0},		/* Wash + 22 */
-	{INS_WAITWATER, 0},
-	{INS_RETURN,	0}
+const unsigned char		scoop[] = {
+	INS(BOWL,	BOWL_CW),	/* Scoop 3 */
+	INS(ARM,	INS_ARM__DOWN),
+	INS(WAITTIME,	MS(21769)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 3 + 1 */
+	INS(WAITTIME,	MS(932)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 3 + 2 */
+	INS(RETURN,	0)
 };
 
-const struct instruction	drain_dry[] = {
-	{INS_PUMP,	1},		/* Wash + 29 */
-	{INS_BOWL,	BOWL_CCW},
-	{INS_WAITTIME,	65535},
-	{INS_BOWL,	BOWL_CW},	/* Wash + 30 */
-	{INS_WAITTIME,	10075},
-	{INS_BOWL,	BOWL_STOP},	/* Wash + 31 */
-	{INS_AUTODOSE,	10},		/* 0.98 ml */
-	{INS_WAITDOSAGE,0},
-	{INS_BOWL,	BOWL_CW},	/* Wash + 32 */
-	{INS_WAITTIME,	25270},
-	{INS_BOWL,	BOWL_CCW},	/* Dry */
-	{INS_DRYER,	1},
-	{INS_WAITTIME,	35372},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 1 */
-	{INS_WAITTIME,	55513},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 2 */
-	{INS_WAITTIME,	35277},
-	{INS_PUMP,	0},		/* Dry + 3 */
-	{INS_WAITTIME,	1732},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 4 */
-	{INS_WAITTIME,	55514},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 5 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 6 */
-	{INS_WAITTIME,	55514},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 7 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 8 */
-	{INS_WAITTIME,	45411},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 9 */
-	{INS_WAITTIME,	35404},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 10 */
-	{INS_WAITTIME,	9980},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 11 */
-	{INS_BOWL,	BOWL_STOP},
-	{INS_AUTODOSE,	3},		/* 0.26 ml */
-	{INS_WAITDOSAGE,0},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 12 */
-	{INS_WAITTIME,	5392},
-	{INS_ARM,	INS_ARM__DOWN},	/* Dry + 13 */
-	{INS_WAITTIME,	10303},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 14 */
-	{INS_WAITTIME,	35245},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 15 */
-	{INS_WAITTIME,	45411},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 16 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 17 */
-	{INS_WAITTIME,	45411},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 18 */
-	{INS_WAITTIME,	35404},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 19 */
-	{INS_WAITTIME,	10380},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 20 */
-	{INS_BOWL,	BOWL_STOP},
-	{INS_AUTODOSE,	3},		/* 0.26 ml */
-	{INS_WAITDOSAGE,0},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 21 */
-	{INS_WAITTIME,	4392},
-	{INS_ARM,	INS_ARM__DOWN},	/* Dry + 22 */
-	{INS_WAITTIME,	10803},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 23 */
-	{INS_WAITTIME,	35245},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 24 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 25 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 26 */
-	{INS_WAITTIME,	35308},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 27 */
-	{INS_WAITTIME,	35404},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 28 */
-	{INS_WAITTIME,	11503},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 29 */
-	{INS_WAITTIME,	2169},
-	{INS_ARM,	INS_ARM__DOWN},	/* Dry + 30 */
-	{INS_WAITTIME,	11703},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 31 */
-	{INS_WAITTIME,	45347},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 32 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 33 */
-	{INS_WAITTIME,	45411},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 34 */
-	{INS_WAITTIME,	35309},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 35 */
-	{INS_WAITTIME,	45411},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 36 */
-	{INS_WAITTIME,	35308},
-	{INS_BOWL,	BOWL_CCW},	/* Dry + 37 */
-	{INS_WAITTIME,	45411},
-	{INS_BOWL,	BOWL_CW},	/* Dry + 38 */
-	{INS_RETURN,	0}
+const unsigned char		drain[] = {
+	INS(PUMP,	1),		/* Wash + 15 */
+	INS(WAITTIME,	MS(25206)),
+	INS(PUMP,	0),		/* Wash + 16 */
+	INS(WAITTIME,	MS(75718)),
+	INS(LOOP,	2),
+	INS(PUMP,	1),		/* Wash + 17, Wash + 19 */
+	INS(WAITTIME,	MS(24206)),
+	INS(PUMP,	0),		/* Wash + 18, Wash + 20 */
+	INS(WAITTIME,	MS(8202)),
+	INS(REPEAT,	0),
+	INS(PUMP,	1),		/* Wash + 21 */
+	INS(WAITTIME,	MS(75718)),
+	INS(PUMP,	0),		/* Wash + 22 */
+	INS(WAITWATER, 0),
+	INS(RETURN,	0)
 };
 
-const struct instruction	surface[] = {
-	{INS_WAITTIME,	35404},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 39 */
-	{INS_WAITTIME,	300},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 40 */
-	{INS_WAITTIME,	12203},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 41 */
-	{INS_WAITTIME,	300},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 42 */
-	{INS_WAITTIME,	12203},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 43 */
-	{INS_WAITTIME,	300},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 44 */
-	{INS_WAITTIME,	10203},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 45 */
-	{INS_WAITTIME,	300},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 46 */
-	{INS_WAITTIME,	10202},
-	{INS_ARM,	INS_ARM__UP},	/* Dry + 47 */
-	{INS_WAITTIME,	9170},
-	{INS_ARM,	INS_ARM__DOWN},	/* Dry + 48 */
-	{INS_WAITTIME,	6474},
-	{INS_DRYER,	0},		/* Dry + 49 */
-	{INS_ARM,	INS_ARM__UP},
-	{INS_WAITTIME,	18268},
-	{INS_ARM,	INS_ARM__DOWN},	/* Dry + 50 */
-	{INS_WAITTIME,	2832},
-	{INS_ARM,	INS_ARM__STOP},	/* Dry + 51 */
-	{INS_RETURN,	0}
+const unsigned char		drain_dry[] = {
+	INS(PUMP,	1),		/* Wash + 29 */
+	INS(BOWL,	BOWL_CCW),
+	INS(WAITTIME,	MS(65535)),
+	INS(BOWL,	BOWL_CW),	/* Wash + 30 */
+	INS(WAITTIME,	MS(10075)),
+	INS(BOWL,	BOWL_STOP),	/* Wash + 31 */
+	INS(AUTODOSE,	10),		/* 0.98 ml */
+	INS(WAITDOSAGE,0),
+	INS(BOWL,	BOWL_CW),	/* Wash + 32 */
+	INS(WAITTIME,	MS(25270)),
+	INS(BOWL,	BOWL_CCW),	/* Dry */
+	INS(DRYER,	1),
+	INS(WAITTIME,	MS(35372)),
+	INS(BOWL,	BOWL_CW),	/* Dry + 1 */
+	INS(WAITTIME,	MS(55513)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 2 */
+	INS(WAITTIME,	MS(35277)),
+	INS(PUMP,	0),		/* Dry + 3 */
+	INS(WAITTIME,	MS(1732)),
+	INS(LOOP,	2),
+	INS(BOWL,	BOWL_CW),	/* Dry + 4, Dry + 6 */
+	INS(WAITTIME,	MS(55514)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 5, Dry + 7 */
+	INS(WAITTIME,	MS(35309)),
+	INS(REPEAT,	0),
+	INS(BOWL,	BOWL_CW),	/* Dry + 8 */
+	INS(WAITTIME,	MS(45411)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 9 */
+	INS(WAITTIME,	MS(35404)),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 10 */
+	INS(WAITTIME,	MS(9980)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 11 */
+	INS(BOWL,	BOWL_STOP),
+	INS(AUTODOSE,	3),		/* 0.26 ml */
+	INS(WAITDOSAGE,0),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 12 */
+	INS(WAITTIME,	MS(5392)),
+	INS(ARM,	INS_ARM__DOWN),	/* Dry + 13 */
+	INS(WAITTIME,	MS(10303)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 14 */
+	INS(WAITTIME,	MS(35245)),
+	INS(BOWL,	BOWL_CW),	/* Dry + 15 */
+	INS(WAITTIME,	MS(45411)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 16 */
+	INS(WAITTIME,	MS(35309)),
+	INS(BOWL,	BOWL_CW),	/* Dry + 17 */
+	INS(WAITTIME,	MS(45411)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 18 */
+	INS(WAITTIME,	MS(35404)),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 19 */
+	INS(WAITTIME,	MS(10380)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 20 */
+	INS(BOWL,	BOWL_STOP),
+	INS(AUTODOSE,	3),		/* 0.26 ml */
+	INS(WAITDOSAGE,0),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 21 */
+	INS(WAITTIME,	MS(4392)),
+	INS(ARM,	INS_ARM__DOWN),	/* Dry + 22 */
+	INS(WAITTIME,	MS(10803)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 23 */
+	INS(WAITTIME,	MS(35245)),
+	INS(BOWL,	BOWL_CW),	/* Dry + 24 */
+	INS(WAITTIME,	MS(35309)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 25 */
+	INS(WAITTIME,	MS(35309)),
+	INS(BOWL,	BOWL_CW),	/* Dry + 26 */
+	INS(WAITTIME,	MS(35308)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 27 */
+	INS(WAITTIME,	MS(35404)),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 28 */
+	INS(WAITTIME,	MS(11503)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 29 */
+	INS(WAITTIME,	MS(2169)),
+	INS(ARM,	INS_ARM__DOWN),	/* Dry + 30 */
+	INS(WAITTIME,	MS(11703)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 31 */
+	INS(WAITTIME,	MS(45347)),
+	INS(LOOP,	2),
+	INS(BOWL,	BOWL_CW),	/* Dry + 32, Dry + 34 */
+	INS(WAITTIME,	MS(35309)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 33, Dry + 35 */
+	INS(WAITTIME,	MS(45411)),
+	INS(REPEAT,	0),
+	INS(BOWL,	BOWL_CW),	/* Dry + 36 */
+	INS(WAITTIME,	MS(35308)),
+	INS(BOWL,	BOWL_CCW),	/* Dry + 37 */
+	INS(WAITTIME,	MS(45411)),
+	INS(BOWL,	BOWL_CW),	/* Dry + 38 */
+	INS(RETURN,	0)
 };
 
+const unsigned char		surface[] = {
+	INS(WAITTIME,	MS(35404)),
+	INS(LOOP,	2),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 39, Dry + 41 */
+	INS(WAITTIME,	MS(300)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 40, Dry + 42 */
+	INS(WAITTIME,	MS(12203)),
+	INS(REPEAT,	0),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 43 */
+	INS(WAITTIME,	MS(300)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 44 */
+	INS(WAITTIME,	MS(10203)),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 45 */
+	INS(WAITTIME,	MS(300)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 46 */
+	INS(WAITTIME,	MS(10202)),
+	INS(ARM,	INS_ARM__UP),	/* Dry + 47 */
+	INS(WAITTIME,	MS(9170)),
+	INS(ARM,	INS_ARM__DOWN),	/* Dry + 48 */
+	INS(WAITTIME,	MS(6474)),
+	INS(DRYER,	0),		/* Dry + 49 */
+	INS(ARM,	INS_ARM__UP),
+	INS(WAITTIME,	MS(18268)),
+	INS(ARM,	INS_ARM__DOWN),	/* Dry + 50 */
+	INS(WAITTIME,	MS(2832)),
+	INS(ARM,	INS_ARM__STOP),	/* Dry + 51 */
+	INS(RETURN,	0)
+};
 
 /*
  * Clean-up program
  */
-const struct instruction	cleanupprogram[] = {
-	{INS_START,	INS_END |
+const unsigned char		cleanupprogram[] = {
+	INS(START,	INS_LAST |
 			FLAGS_DRYRUN |
-			FLAGS_WETRUN },
+			FLAGS_WETRUN ),
 #if defined TEST_NOPROGRAM
-	{INS_WAITTIME,	3000},
+	INS(WAITTIME,	MS(3000)),
 #else /* TEST_NOPROGRAM */
-	{INS_BOWL,	BOWL_CW},
-	{INS_ARM,	INS_ARM__DOWN},
-	{INS_WAITTIME,	21769},
-	{INS_ARM,	INS_ARM__UP},
-	{INS_WAITTIME,	932},
-	{INS_ARM,	INS_ARM__STOP},
-	{INS_SKIPIFDRY, 1},		/* Skip to surfacing for dry program */
+	INS(CALL,	ROM_SCOOP),
+	INS(SKIPIFDRY, 1),		/* Skip to surfacing for dry program */
 	/* Drain the bowl */
-	{INS_CALL,	(unsigned int)drain_dry},
+	INS(CALL,	ROM_DRAIN_DRY),
 	/* Surface the granules */
-	{INS_CALL,	(unsigned int)surface},
-	{INS_BOWL,	BOWL_STOP},
+	INS(CALL,	ROM_SURFACE),
+	INS(BOWL,	BOWL_STOP),
 #endif /* TEST_NOPROGRAM */
-	{INS_END,	0}
+	INS(END,	0)
 };
 
 
 /*
  * Washing program
  */
-const struct instruction	washprogram[] = {
-	{INS_START,	INS_END |
+const unsigned char		washprogram[] = {
+	INS(START,	INS_LAST |
 			FLAGS_DRYRUN |
-			FLAGS_WETRUN },
+			FLAGS_WETRUN ),
 #if defined TEST_NOPROGRAM
-	{INS_WAITTIME,	3000},
+	INS(WAITTIME,	MS(3000)),
 #elif defined TEST_ARM
-	{INS_ARM,	INS_ARM__MAX},
-	{INS_WAITTIME,	15000},
-	{INS_ARM,	INS_ARM__HOME},
-	{INS_WAITTIME,	15000},
+	INS(ARM,	INS_ARM__MAX),
+	INS(WAITTIME,	MS(15000)),
+	INS(ARM,	INS_ARM__HOME),
+	INS(WAITTIME,	MS(15000)),
 #else /* No tests; Regular washing program */
-	{INS_BOWL,	BOWL_CCW},	/* Scoop 1 */
-	{INS_ARM,	INS_ARM__DOWN},
-	{INS_WAITTIME,	13217},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 1 + 1 */
-	{INS_WAITTIME,	18141},
-	{INS_BOWL,	BOWL_CW},	/* Scoop 1 + 2 */
-	{INS_WAITTIME,	6201},
-	{INS_BOWL,	BOWL_CCW},	/* Scoop 1 + 3 */
-	{INS_ARM,	INS_ARM__DOWN},
-	{INS_WAITTIME,	5765},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 1 + 4 */
-	{INS_WAITTIME,	532},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 1 + 5 */
-	{INS_WAITTIME,	25206},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 1 + 6 */
-	{INS_WAITTIME,	10671},
-	{INS_ARM,	INS_ARM__DOWN},	/* Scoop 1 + 7 */
-	{INS_WAITTIME,	6602},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 1 + 8 */
-	{INS_WAITTIME,	17204},
-	{INS_ARM,	INS_ARM__DOWN},	/* Scoop 2 */
-	{INS_WAITTIME,	12703},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 2 + 1 */
-	{INS_WAITTIME,	4701},
-	{INS_ARM,	INS_ARM__DOWN},	/* Scoop 2 + 2 */
-	{INS_WAITTIME,	11203},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 2 + 3 */
-	{INS_WAITTIME,	532},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 2 + 4 */
-	{INS_WAITTIME,	25206},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 2 + 5 */
-	{INS_WAITTIME,	10671},
-	{INS_ARM,	INS_ARM__DOWN},	/* Scoop 2 + 6 */
-	{INS_WAITTIME,	6601},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 2 + 7 */
-	{INS_WAITTIME,	20141},
-	{INS_BOWL,	BOWL_CW},	/* Scoop 3 */
-	{INS_ARM,	INS_ARM__DOWN},
-	{INS_WAITTIME,	21769},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 3 + 1 */
-	{INS_WAITTIME,	932},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 3 + 2 */
+	INS(BOWL,	BOWL_CCW),	/* Scoop 1 */
+	INS(ARM,	INS_ARM__DOWN),
+	INS(WAITTIME,	MS(13217)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 1 + 1 */
+	INS(WAITTIME,	MS(18141)),
+	INS(BOWL,	BOWL_CW),	/* Scoop 1 + 2 */
+	INS(WAITTIME,	MS(6201)),
+	INS(BOWL,	BOWL_CCW),	/* Scoop 1 + 3 */
+	INS(ARM,	INS_ARM__DOWN),
+	INS(WAITTIME,	MS(5765)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 1 + 4 */
+	INS(WAITTIME,	MS(532)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 1 + 5 */
+	INS(WAITTIME,	MS(25206)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 1 + 6 */
+	INS(WAITTIME,	MS(10671)),
+	INS(ARM,	INS_ARM__DOWN),	/* Scoop 1 + 7 */
+	INS(WAITTIME,	MS(6602)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 1 + 8 */
+	INS(WAITTIME,	MS(17204)),
+	INS(ARM,	INS_ARM__DOWN),	/* Scoop 2 */
+	INS(WAITTIME,	MS(12703)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 2 + 1 */
+	INS(WAITTIME,	MS(4701)),
+	INS(ARM,	INS_ARM__DOWN),	/* Scoop 2 + 2 */
+	INS(WAITTIME,	MS(11203)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 2 + 3 */
+	INS(WAITTIME,	MS(532)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 2 + 4 */
+	INS(WAITTIME,	MS(25206)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 2 + 5 */
+	INS(WAITTIME,	MS(10671)),
+	INS(ARM,	INS_ARM__DOWN),	/* Scoop 2 + 6 */
+	INS(WAITTIME,	MS(6601)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 2 + 7 */
+	INS(WAITTIME,	MS(20141)),
+	INS(CALL,	ROM_SCOOP),	/* Scoop 3 */
 
-	{INS_SKIPIFDRY, 53},		/* Skip to surfacing for dry program */
+	INS(SKIPIFDRY, 53),		/* Skip to surfacing for dry program */
 
-	{INS_WAITTIME,	12108},
-	{INS_BOWL,	BOWL_CCW},	/* Scoop 3 + 3 */
-	{INS_ARM,	INS_ARM__DOWN},
-	{INS_WAITTIME,	3264},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 3 + 4 */
-	{INS_WAITTIME,	532},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 3 + 5 */
-	{INS_WAITTIME,	24206},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 3 + 6 */
-	{INS_WAITTIME,	10571},
-	{INS_ARM,	INS_ARM__DOWN},	/* Scoop 3 + 7 */
-	{INS_WAITTIME,	6602},
-	{INS_ARM,	INS_ARM__UP},	/* Scoop 3 + 8 */
-	{INS_WAITTIME,	17141},
-	{INS_ARM,	INS_ARM__STOP},	/* Scoop 3 + 9 */
+	INS(WAITTIME,	MS(12108)),
+	INS(BOWL,	BOWL_CCW),	/* Scoop 3 + 3 */
+	INS(ARM,	INS_ARM__DOWN),
+	INS(WAITTIME,	MS(3264)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 3 + 4 */
+	INS(WAITTIME,	MS(532)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 3 + 5 */
+	INS(WAITTIME,	MS(24206)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 3 + 6 */
+	INS(WAITTIME,	MS(10571)),
+	INS(ARM,	INS_ARM__DOWN),	/* Scoop 3 + 7 */
+	INS(WAITTIME,	MS(6602)),
+	INS(ARM,	INS_ARM__UP),	/* Scoop 3 + 8 */
+	INS(WAITTIME,	MS(17141)),
+	INS(ARM,	INS_ARM__STOP),	/* Scoop 3 + 9 */
 	/* Wash the bowl */
-	{INS_WAITWATER, 0},
-	{INS_WATER,	1},
-	{INS_BOWL,	BOWL_CW},
-	{INS_WAITTIME,	18768},
-	{INS_ARM,	INS_ARM__DOWN},	/* Wash */
-	{INS_WAITTIME,	25206},
-	{INS_ARM,	INS_ARM__UP},	/* Wash + 1 */
-	{INS_WAITTIME,	1132},
-	{INS_ARM,	INS_ARM__STOP},	/* Wash + 2 */
-	{INS_WAITWATER, 1},		/* Wash + 3 */
-	{INS_WAITTIME,	63582},		/* From full program sheet */
+	INS(WAITWATER, 0),
+	INS(WATER,	1),
+	INS(BOWL,	BOWL_CW),
+	INS(WAITTIME,	MS(18768)),
+	INS(ARM,	INS_ARM__DOWN),	/* Wash */
+	INS(WAITTIME,	MS(25206)),
+	INS(ARM,	INS_ARM__UP),	/* Wash + 1 */
+	INS(WAITTIME,	MS(1132)),
+	INS(ARM,	INS_ARM__STOP),	/* Wash + 2 */
+	INS(WAITWATER, 1),		/* Wash + 3 */
+	INS(WAITTIME,	MS(63582)),		/* From full program sheet */
 	/* Drain the bowl */
-	{INS_CALL,	(unsigned int)drain},
+	INS(CALL,	ROM_DRAIN),
 	/* Wash the bowl */
-	{INS_WATER,	1},
-	{INS_WAITTIME,	55418},
-	{INS_BOWL,	BOWL_CCW},	/* Wash + 12 */
-	{INS_AUTODOSE,	3},		/* 0.26 ml */
-	{INS_WAITDOSAGE,0},
-	{INS_BOWL,	BOWL_CW},
-	{INS_WAITWATER, 1},		/* Wash + 14 */
-	{INS_WAITTIME,	44002},		/* From full program sheet */
+	INS(WATER,	1),
+	INS(WAITTIME,	MS(55418)),
+	INS(BOWL,	BOWL_CCW),	/* Wash + 12 */
+	INS(AUTODOSE,	3),		/* 0.26 ml */
+	INS(WAITDOSAGE,0),
+	INS(BOWL,	BOWL_CW),
+	INS(WAITWATER, 1),		/* Wash + 14 */
+	INS(WAITTIME,	MS(44002)),		/* From full program sheet */
 	/* Drain the bowl */
-	{INS_CALL,	(unsigned int)drain},
+	INS(CALL,	ROM_DRAIN),
 	/* Wash the bowl */
-	{INS_WATER,	1},
-	{INS_WAITTIME,	25502},
-	{INS_ARM,	INS_ARM__DOWN},	/* Wash + 23 */
-	{INS_WAITTIME,	21205},
-	{INS_ARM,	INS_ARM__UP},	/* Wash + 24 */
-	{INS_BOWL,	BOWL_STOP},
-	{INS_AUTODOSE,	11},		/* 1.07 ml */
-	{INS_WAITTIME,	1132},
-	{INS_ARM,	INS_ARM__STOP},	/* Wash + 25 */
-	{INS_WAITDOSAGE,0},
-	{INS_BOWL,	BOWL_CCW},
-	{INS_WAITTIME,	5329},
-	{INS_BOWL,	BOWL_CW},	/* Wash + 27 */
-	{INS_WAITTIME,	55482},
-	{INS_WAITWATER, 1},		/* Wash + 28 */
-	{INS_WAITTIME,	39107},
+	INS(WATER,	1),
+	INS(WAITTIME,	MS(25502)),
+	INS(ARM,	INS_ARM__DOWN),	/* Wash + 23 */
+	INS(WAITTIME,	MS(21205)),
+	INS(ARM,	INS_ARM__UP),	/* Wash + 24 */
+	INS(BOWL,	BOWL_STOP),
+	INS(AUTODOSE,	11),		/* 1.07 ml */
+	INS(WAITTIME,	MS(1132)),
+	INS(ARM,	INS_ARM__STOP),	/* Wash + 25 */
+	INS(WAITDOSAGE,0),
+	INS(BOWL,	BOWL_CCW),
+	INS(WAITTIME,	MS(5329)),
+	INS(BOWL,	BOWL_CW),	/* Wash + 27 */
+	INS(WAITTIME,	MS(55482)),
+	INS(WAITWATER, 1),		/* Wash + 28 */
+	INS(WAITTIME,	MS(39107)),
 	/* Drain the bowl */
-	{INS_CALL,	(unsigned int)drain_dry},
+	INS(CALL,	ROM_DRAIN_DRY),
 	/* Surface the granules */
-	{INS_CALL,	(unsigned int)surface},
-	{INS_BOWL,	BOWL_STOP},
+	INS(CALL,	ROM_SURFACE),
+	INS(BOWL,	BOWL_STOP),
 #endif /* TEST_* */
-	{INS_END,	0}
+	INS(END,	0)
 };
 
+/*
+ * Program tables, in image order
+ */
+#define TABLE(table)	{ table, SIZE(table) }
+static const struct {
+	unsigned char		const * table;
+	unsigned char		size;
+} tables[] = {
+	TABLE(scoop),			/* ROM_SCOOP */
+	TABLE(drain),			/* ROM_DRAIN */
+	TABLE(drain_dry),		/* ROM_DRAIN_DRY */
+	TABLE(surface),			/* ROM_SURFACE */
+	TABLE(cleanupprogram),		/* ROM_CLEANUPPROGRAM */
+	TABLE(washprogram)		/* ROM_WASHPROGRAM */
+};
+
+const unsigned int		rom_washprogram		= ROM_WASHPROGRAM;
+const unsigned int		rom_cleanupprogram	= ROM_CLEANUPPROGRAM;
+
 
 /******************************************************************************/
 /* Local Prototypes							      */
@@ -344,15 +367,35 @@ const struct instruction	washprogram[] = {
 /* Global Implementations						      */
 /******************************************************************************/
 
-void romwashprogram_reqins (struct instruction const * address)
+void romwashprogram_reqins (unsigned int address)
 {
 	ins_address = address;
 }
 
-unsigned char romwashprogram_getins (struct instruction * const instruction)
+unsigned char romwashprogram_getins (unsigned char * const ins)
 {
-	*instruction = *ins_address;
+	unsigned int	index = ins_address;
+	unsigned char	table;
+	unsigned char	const * record;
+
+	/* Find the table the instruction is in */
+	for (table = 0; table < sizeof(tables) / sizeof(tables[0]); table++) {
+		if (index < tables[table].size) {
+			record = &tables[table].table[index * INS_SIZE];
+			ins[0] = record[0];
+			ins[1] = record[1];
+			ins[2] = record[2];
+			ins[3] = record[3];
+			return 1;
+		}
+		index -= tables[table].size;
+	}
 
+	/* Running off the image is an execution error */
+	ins[0] = INS_INVALID;
+	ins[1] = 0;
+	ins[2] = 0;
+	ins[3] = 0;
 	return 1;
 }
 
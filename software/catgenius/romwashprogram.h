@@ -8,10 +8,14 @@
 #ifndef ROMWASHPROGRAM_H			/* Include file already compiled? */
 #define ROMWASHPROGRAM_H
 
+/* Entry points of the programs, as instruction indices into the ROM image */
+extern const unsigned int	rom_washprogram;
+extern const unsigned int	rom_cleanupprogram;
+
 
 /* Control */
-void		romwashprogram_reqins	(struct instruction const *       address) ;
-unsigned char	romwashprogram_getins	(struct instruction       * const instruction) ;
+void		romwashprogram_reqins	(unsigned int			  address) ;
+unsigned char	romwashprogram_getins	(unsigned char		  * const ins) ;
 
 
 #endif /* ROMWASHPROGRAM_H */
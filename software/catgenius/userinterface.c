@@ -18,8 +18,10 @@
 #include "../common/timer.h"
 #include "../common/rtc.h"
 #include "litterlanguage.h"
+#include "cartridge.h"
 #include "../common/eventlog.h"
 #include "../common/serial.h"
+#include "../common/nvm.h"
 
 #ifdef HAS_DIAG
 #include "../common/water.h"		// For water_detected()
@@ -102,17 +104,23 @@ void userinterface_init (unsigned char flags)
 /*		- Initial revision.					      */
 /******************************************************************************/
 {
+	/* Queue the timers */
+	timer_register(&cartridgetimeout, TIMER_OWNER_USERINTERFACE);
+	timer_register(&holdtimeout, TIMER_OWNER_USERINTERFACE);
+	timer_register(&autotimer, TIMER_OWNER_USERINTERFACE);
+	timer_register(&cattimer, TIMER_OWNER_USERINTERFACE);
+
 	if ((flags & START_BUTTON) &&
 	    (flags & SETUP_BUTTON)) {
 		/* User wants to reset non-volatile settings */
-		eeprom_write(NVM_MODE, AUTO_MANUAL);
-		eeprom_write(NVM_KEYUNDLOCK, 0xFF);
+		nvm_write(NVM_MODE, AUTO_MANUAL);
+		nvm_write(NVM_KEYUNDLOCK, 0xFF);
 	}
 
 	/* Restore key lock mode from eeprom */
-	locked = !eeprom_read(NVM_KEYUNDLOCK);
+	locked = !nvm_read(NVM_KEYUNDLOCK);
 	/* Restore current mode from eeprom */
-	userinterface_set_mode(eeprom_read(NVM_MODE));
+	userinterface_set_mode(nvm_read(NVM_MODE));
 }
 /* userinterface_init */
 
@@ -128,6 +136,7 @@ void userinterface_work (void)
 	unsigned char		update		= 0;
 
 	if( (panel_mode == PANEL_CARTRIDGELEVEL) &&
+	    (timer_due(TIMER_OWNER_USERINTERFACE)) &&
 	    (timeoutexpired(&cartridgetimeout)) ) {
 		if (error_nr)
 			panel_mode = PANEL_ERROR;
@@ -141,7 +150,8 @@ void userinterface_work (void)
 		state = STATE_IDLE;
 	case STATE_IDLE:
 		/* Check if it's time for a timed wash */
-		if (timeoutexpired(&autotimer)) {
+		if (timer_due(TIMER_OWNER_USERINTERFACE) &&
+		    timeoutexpired(&autotimer)) {
 			/* Schedule the next timed wash */
 			update_autotimer(auto_mode);
 			printtime();
@@ -157,7 +167,9 @@ void userinterface_work (void)
 		break;
 	case STATE_CAT:
 		/* Wait until the cat has gone */
-		if (!cat_present && timeoutexpired(&cattimer)) {
+		if (!cat_present &&
+		    timer_due(TIMER_OWNER_USERINTERFACE) &&
+		    timeoutexpired(&cattimer)) {
 			printtime();
 			DBG("Cattimer expired\n");
 			litterlanguage_start(full_wash);
@@ -209,7 +221,8 @@ void userinterface_work (void)
 	buttonmask_evt = 0;
 
 	/* Handle held buttons */
-	if (timeoutexpired(&holdtimeout)) {
+	if (timer_due(TIMER_OWNER_USERINTERFACE) &&
+	    timeoutexpired(&holdtimeout)) {
 		switch (buttonmask_cum & BUTTONS) {
 		case START_BUTTON:
 			key_Beep(2);
@@ -341,6 +354,14 @@ void catsensor_event (unsigned char detected)
 
 void litterlanguage_event (unsigned char event, unsigned char argument)
 {
+	/* Keep what led up to an error for a post-mortem */
+	if (((event == EVENT_ERR_FILLING) ||
+	     (event == EVENT_ERR_DRAINING) ||
+	     (event == EVENT_ERR_OVERHEAT) ||
+	     (event == EVENT_ERR_FLOOD)) &&
+	    (argument))
+		eventlog_snapshot(event, argument);
+
 	/* Stop the washing program upon fatal errors */
 	if ((event == EVENT_ERR_EXECUTION) &&
 	    (argument)) {
@@ -456,7 +477,7 @@ void userinterface_set_mode (unsigned char mode)
 	cat_detected = 0;
 
 	/* Store the new mode in EEPROM */
-	eeprom_write(NVM_MODE, auto_mode);
+	nvm_write(NVM_MODE, auto_mode);
 
 	update_display();
 }
@@ -467,6 +488,11 @@ void update_display (void)
 	int i;
 #endif
 
+#ifdef HAS_CARTRIDGE
+	/* The level follows the detergent dispensed */
+	cart_level = cartridge_level();
+#endif
+
 	switch (panel_mode) {
 	default:
 		panel_mode = PANEL_AUTOMODE;
@@ -576,6 +602,9 @@ void setup_short (void)
 			cart_level = 100;
 		else
 			cart_level = 0;
+#ifdef HAS_CARTRIDGE
+		cartridge_set_level(cart_level);
+#endif
 		/* Set new timeout to return to auto- or errormode */
 		settimeout(&cartridgetimeout, LEVEL_TIMEOUT);
 		break;
@@ -719,7 +748,7 @@ void both_long (void)
 	DBG("Start+Setup: long\n");
 
 	locked = !locked;
-	eeprom_write(NVM_KEYUNDLOCK, !locked);
+	nvm_write(NVM_KEYUNDLOCK, !locked);
 
 	update_display();
 }
@@ -22,7 +22,7 @@ extern void setupbutton_event (unsigned char up);
 #include "../common/catgenie120.h"
 #include <stdio.h>
 static unsigned long arm_pos = 0;
-static struct timer arm_start = 0;
+static struct timer arm_start = EXPIRED;
 #endif
 
 
@@ -217,7 +217,10 @@ unsigned char catgenie_init (void)
 		unsigned char	mask = 1 << debouncers[temp].port_bit; /* for compiler limitations */
 
 		debouncers[temp].state = *debouncers[temp].port & mask;
+		timer_register(&debouncers[temp].timer, TIMER_OWNER_CATGENIE);
 	}
+	for (temp = 0; temp < PACER_MAX; temp++)
+		timer_register(&pacers[temp].timer, TIMER_OWNER_CATGENIE);
 
 	/* Fill out the return flags */
 	temp = 0;
@@ -268,7 +271,8 @@ void catgenie_work (void)
 
 	/* Execute the debouncers */
 	for (temp = 0; temp < DEBOUNCER_MAX; temp++)
-		if (timeoutexpired(&debouncers[temp].timer)) {
+		if (timer_due(TIMER_OWNER_CATGENIE) &&
+		    timeoutexpired(&debouncers[temp].timer)) {
 			unsigned char	tempstate = *debouncers[temp].port; /* for compiler limitations */
 			tempstate &= 1 << debouncers[temp].port_bit;
 			/* Check if the state changed */
@@ -282,7 +286,8 @@ void catgenie_work (void)
 
 	/* Execute the pacers */
 	for (temp = 0; temp < PACER_MAX; temp++)
-		if (timeoutexpired(&pacers[temp].timer)) {
+		if (timer_due(TIMER_OWNER_CATGENIE) &&
+		    timeoutexpired(&pacers[temp].timer)) {
 			unsigned char	mask = 1 << pacers[temp].pattern_bit; /* for compiler limitations */
 
 			/* Set a time for the next execution time */
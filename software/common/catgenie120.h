@@ -54,10 +54,23 @@ extern void get_ArmPosition (unsigned long *pos, unsigned char *mode);
 #define MAX_DRAINTIME		((0*60+10)*SECOND)
 
 /* EEPROM layout */
+/* Settings, kept in the journal by their address when HAS_NVMJOURNAL */
 #define NVM_VERSION		(0)
 #define NVM_MODE		(1)
 #define NVM_KEYUNDLOCK		(2)
 #define NVM_BOXSTATE		(3)
+#define NVM_PRGSOURCE		(4)
+#define NVM_CARTLEVEL		(5)	/* Detergent left in 2 ml */
+#define NVM_CARTUSE		(6)	/* Average detergent per wash in 0.1 ml */
+#define NVM_KEYS		(7)
+#define NVM_JOURNAL		(0x08)	/* Settings journal, see nvm.c */
+#define NVM_JOURNAL_SIZE	(0x28)
+#define NVM_EVENTS		(0x30)	/* Events before the last error, see eventlog.c */
+#define NVM_EVENTS_SIZE		(0x30)
+#define NVM_MACRO		(0x60)	/* Command line macro, 0-terminated */
+#define NVM_MACRO_SIZE		(0x20)
+#define NVM_PROGRAM		(0x80)	/* EEPROM wash program */
+#define NVM_PROGRAM_SIZE	(0x80)
 
 /* Init return flags */
 #define START_BUTTON		(0x01 << 0)
@@ -72,6 +72,10 @@ void catsensor_init (void)
 	TMR2IF = 0;
 	/* Enable timer 2 interrupt */
 	TMR2IE = 1;
+
+	/* Queue the timers */
+	timer_register(&debouncer, TIMER_OWNER_CATSENSOR);
+	timer_register(&pingtime, TIMER_OWNER_CATSENSOR);
 }
 /* End: catsensor_init */
 
@@ -85,6 +89,7 @@ void catsensor_work (void)
 /******************************************************************************/
 {
 	if (!pinging &&
+	    timer_due(TIMER_OWNER_CATSENSOR) &&
 	    timeoutexpired(&pingtime)) {
 	    	/* Set timer for next ping */
 		settimeout(&pingtime, PING_TIME);
@@ -116,7 +121,8 @@ void catsensor_work (void)
 	}
 
 	/* Notify is changed */
-	if (timeoutexpired(&debouncer)) {
+	if (timer_due(TIMER_OWNER_CATSENSOR) &&
+	    timeoutexpired(&debouncer)) {
 		timeoutnever(&debouncer);
 		if (detected_cur != detected_dbc) {
 			detected_dbc = detected_cur;
@@ -126,6 +132,20 @@ void catsensor_work (void)
 } /* catsensor_work */
 
 
+unsigned char catsensor_busy (void)
+/******************************************************************************/
+/* Function:	catsensor_busy						      */
+/*		- Returns true while a ping is on its way, which needs timer  */
+/*		  2 to keep running					      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	return (pinging);
+}
+/* End: catsensor_busy */
+
+
 void catsensor_isr_timer (void)
 /******************************************************************************/
 /* Function:	Timer interrupt service routine				      */
@@ -11,6 +11,7 @@
 /* Generic */
 void		catsensor_init		(void) ;
 void		catsensor_work		(void) ;
+unsigned char	catsensor_busy		(void) ;
 
 /* Event notification */
 void		catsensor_isr_timer	(void) ;
@@ -22,9 +22,11 @@
 
 #include "../common/hardware.h"	/* For _XTAL_FREQ */
 #include "timer.h"				/* For timing definitions/functions */
+#include "frame.h"
 
 #ifdef APP_CATGENIUS
 #include "../catgenius/userinterface.h"		/* For set_mode() */
+#include "../catgenius/cartridge.h"
 #endif
 
 /******************************************************************************/
@@ -36,6 +38,8 @@
 #define ENQ		0x05
 #define ACK		0x06
 
+#define MACRO_STORED	0xFF	/* No byte of the macro left to store */
+
 /******************************************************************************/
 /* Global Data								      */
 /******************************************************************************/
@@ -48,14 +52,26 @@ extern const struct 	command	commands[];
 
 static char				linebuffer[LINEBUFFER_MAX];
 static unsigned char	localecho = 1;
+static unsigned char	commands_count = 0;
+#ifdef HAS_COMMANDLINE_MACRO
+static char				macro[NVM_MACRO_SIZE];
+static unsigned char	macro_running = 0;
+static unsigned char	macro_store = MACRO_STORED;	/* Next byte to store */
+#endif /* HAS_COMMANDLINE_MACRO */
 
 /******************************************************************************/
 /* Local Prototypes							      */
 /******************************************************************************/
 
 static void proc_char (char rxd);
-static void proc_line (char *line);
+static int proc_batch (char *line);
+static int proc_line (char *line);
 static int cmd2index (char *cmd);
+#ifdef HAS_COMMANDLINE_MACRO
+static unsigned char macro_define (const char *line);
+static void macro_work (void);
+static void macro_read (void);
+#endif /* HAS_COMMANDLINE_MACRO */
 
 
 /******************************************************************************/
@@ -70,6 +86,18 @@ void cmdline_init (void)
 /*		- Ported from other project.				      */
 /******************************************************************************/
 {
+	/* The table ends with a command without function */
+	while (commands[commands_count].function) {
+#ifdef __DEBUG
+		/* cmd2index() doesn't find commands that are out of order */
+		if (commands_count &&
+		    (strncmp(commands[commands_count - 1].cmd,
+			     commands[commands_count].cmd, COMMAND_MAX) >= 0))
+			TX2("Command '%s' out of order\n", commands[commands_count].cmd);
+#endif /* __DEBUG */
+		commands_count++;
+	}
+
 	if (localecho)
 		TX(PROMPT);
 }
@@ -85,8 +113,29 @@ void cmdline_work (void)
 /******************************************************************************/
 {
 	char rxd ;
-
-	while (readch(&rxd))
+#ifdef HAS_FRAMING
+	static unsigned char enquired = 0;
+#endif /* HAS_FRAMING */
+
+#ifdef HAS_COMMANDLINE_MACRO
+	macro_work();
+#endif /* HAS_COMMANDLINE_MACRO */
+
+	while (readch(&rxd)) {
+#ifdef HAS_FRAMING
+		if (frame_active()) {
+			frame_rx(rxd);
+			continue;
+		}
+		/* A frame right after the handshake switches to framing */
+		if (enquired && (rxd == FRAME_SOH)) {
+			enquired = 0;
+			frame_open();
+			frame_rx(rxd);
+			continue;
+		}
+		enquired = (rxd == ENQ);
+#endif /* HAS_FRAMING */
 		switch(rxd) {
 		case ENQ:
 			putch(ACK);
@@ -94,10 +143,22 @@ void cmdline_work (void)
 		default:
 			proc_char(rxd);
 		}
+	}
 }
 /* End: cmdline_work */
 
 
+unsigned char cmdline_busy (void)
+{
+#ifdef HAS_COMMANDLINE_MACRO
+	/* The macro is stored a byte per pass */
+	return (macro_store != MACRO_STORED);
+#else
+	return 0;
+#endif /* HAS_COMMANDLINE_MACRO */
+}
+
+
 /******************************************************************************/
 /* Local Implementations						      */
 /******************************************************************************/
@@ -126,7 +187,7 @@ static void proc_char (char rxd)
 			/* Terminate string */
 			linebuffer[curcolumn] = 0;
 			/* Process string */
-			proc_line(linebuffer);
+			proc_batch(linebuffer);
 		}
 		curcolumn = 0;
 
@@ -149,12 +210,46 @@ static void proc_char (char rxd)
 }
 
 
-static void proc_line (char *line)
+static int proc_batch (char *line)
+/******************************************************************************/
+/* Function:	proc_batch						      */
+/*		- Processes the ';'-separated commands of a line in order, up */
+/*		  to the first one that fails, so a host can send a sequence  */
+/*		  in one go and only wait for the prompt once		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	char	*next;
+	int	result;
+
+#ifdef HAS_COMMANDLINE_MACRO
+	/* A macro definition takes the rest of the line, separators and all */
+	if (macro_define(line))
+		return ERR_OK;
+#endif /* HAS_COMMANDLINE_MACRO */
+
+	do {
+		next = strchr(line, ';');
+		if (next)
+			*next++ = 0;
+		result = proc_line(line);
+		if (result != ERR_OK)
+			return result;
+		line = next;
+	} while (line);
+
+	return ERR_OK;
+}
+
+
+static int proc_line (char *line)
 {
 	unsigned int	len = strlen(line);
 	int		argc = 0;
 	char*		argv[ARGS_MAX];
 	int		index;
+	int		result;
 
 	/* Trim trailing white spaces */
 	while (len && (line[len-1] == ' ' || line[len-1] == '\t')) {
@@ -172,6 +267,10 @@ static void proc_line (char *line)
 
 		/* Store the beginning of this argument */
 		if (*line) {
+			if (argc >= ARGS_MAX) {
+				TX("Syntax error\n");
+				return ERR_SYNTAX;
+			}
 			argv[argc] = line;
 			argc++;
 		}
@@ -181,10 +280,15 @@ static void proc_line (char *line)
 			line++;
 	}
 
+	if (!argc)
+		return ERR_OK;
+
 	index = cmd2index(argv[0]);
 	if (index >= 0) {
-		switch (commands[index].function(argc, argv)) {
+		result = commands[index].function(argc, argv);
+		switch (result) {
 		case ERR_OK:
+		case ERR_ABORT:
 			break;
 		case ERR_SYNTAX:
 			TX("Syntax error\n");
@@ -198,25 +302,101 @@ static void proc_line (char *line)
 		default:
 			TX("Unknown error\n");
 		}
-	} else
-		TX2("Unknown command '%s'\n", argv[0]);
+		return result;
+	}
+
+	TX2("Unknown command '%s'\n", argv[0]);
+	return ERR_SYNTAX;
 }
 
 
 static int cmd2index (char *cmd)
 {
-	int index = 0;
-
-	while (commands[index].function) {
-		if (!strncmp (cmd, commands[index].cmd, COMMAND_MAX))
+	unsigned char	first = 0;
+	unsigned char	last = commands_count;	/* One past the last */
+	unsigned char	index;
+	int		order;
+
+	/* Binary search, the table is sorted by name */
+	while (first < last) {
+		index = (first + last) / 2;
+		order = strncmp (cmd, commands[index].cmd, COMMAND_MAX);
+		if (!order)
 			return index;
-		index++;
+		if (order < 0)
+			last = index;
+		else
+			first = index + 1;
 	}
 
 	return (-1);
 }
 
 
+#ifdef HAS_COMMANDLINE_MACRO
+static unsigned char macro_define (const char *line)
+{
+	/* 'macro = <commands>' */
+	if (strncmp(line, "macro", 5))
+		return 0;
+	line += 5;
+	while ((*line == ' ') || (*line == '\t'))
+		line++;
+	if (*line != '=')
+		return 0;
+	line++;
+	while ((*line == ' ') || (*line == '\t'))
+		line++;
+
+	if (strlen(line) >= NVM_MACRO_SIZE) {
+		TX("Parameter error\n");
+		return 1;
+	}
+	/* Stored by macro_work(), the copy in RAM is current meanwhile */
+	strcpy(macro, line);
+	macro_store = 0;
+
+	TX2("Macro: %s\n", macro);
+	return 1;
+}
+
+
+/* Stores a byte of the macro per pass, only when the EEPROM is ready */
+static void macro_work (void)
+{
+	if ((macro_store == MACRO_STORED) || WR)
+		return;
+
+	/* Only write what changed, including the termination */
+	if (eeprom_read(NVM_MACRO + macro_store) != (unsigned char)macro[macro_store])
+		eeprom_write(NVM_MACRO + macro_store, (unsigned char)macro[macro_store]);
+	if (macro[macro_store])
+		macro_store++;
+	else
+		macro_store = MACRO_STORED;
+}
+
+
+static void macro_read (void)
+{
+	unsigned char	index;
+
+	if (macro_store != MACRO_STORED)
+		return;
+
+	for (index = 0; index < NVM_MACRO_SIZE; index++) {
+		macro[index] = (char)eeprom_read(NVM_MACRO + index);
+		if (!macro[index])
+			return;
+		/* Blank or foreign EEPROM contents */
+		if ((macro[index] < ' ') || (macro[index] > '~'))
+			break;
+	}
+	macro[0] = 0;
+}
+#endif /* HAS_COMMANDLINE_MACRO */
+
+
 int cmd_echo (int argc, char* argv[])
 {
 	if (argc > 2)
@@ -312,19 +492,71 @@ int cmd_lock (int argc, char* argv[])
 
 int cmd_cart (int argc, char* argv[])
 {
-	unsigned char new_value;
+#ifdef HAS_CARTRIDGE
+	unsigned int	left;
 
+	if (argc > 2) return ERR_SYNTAX;
+	if (argc == 2) {
+		/* Level in percent after a refill, or 'full' for a new cartridge */
+		if (!stricmp(argv[1], "full"))
+			cartridge_set_level(100);
+		else if ((atoi(argv[1]) > 0) && (atoi(argv[1]) <= 100))
+			cartridge_set_level((unsigned char)atoi(argv[1]));
+		else if (!strcmp(argv[1], "0"))
+			cartridge_set_level(0);
+		else
+			return ERR_PARAM;
+	}
+
+	both_short();
+
+	left = cartridge_left();
+	TX4("Cart: %u%%, %u.%u ml", cartridge_level(), left / 10, left % 10);
+	/* Forecast from the average use per wash */
+	if (cartridge_use())
+		TX2(", %u washes left", left / cartridge_use());
+	TX("\n");
+#else
 	if (argc != 1) return ERR_SYNTAX;
 
 	both_short();
 
 	TX("Cart: Showing level\n");
+#endif /* HAS_CARTRIDGE */
 
 	return ERR_OK;
 }
 
 #endif // HAS_COMMANDLINE_EXTRA
 
+#ifdef HAS_COMMANDLINE_MACRO
+int cmd_macro (int argc, char* argv[])
+{
+	if (argc > 2) return ERR_SYNTAX;
+
+	macro_read();
+	if (argc == 2) {
+		if (stricmp(argv[1], "run")) return ERR_SYNTAX;
+		/* A macro doesn't get to run itself */
+		if (macro_running) return ERR_PARAM;
+		/* Running splits it up in RAM, before it's stored */
+		if (macro_store != MACRO_STORED) return ERR_IO;
+
+		macro_running = 1;
+		if (proc_batch(macro) != ERR_OK) {
+			macro_running = 0;
+			return ERR_ABORT;
+		}
+		macro_running = 0;
+		return ERR_OK;
+	}
+
+	TX2("Macro: %s\n", macro);
+
+	return ERR_OK;
+}
+#endif // HAS_COMMANDLINE_MACRO
+
 #ifdef HAS_COMMANDLINE_COMTESTS
 int cmd_rxtest (int argc, char* argv[])
 {
@@ -368,6 +600,8 @@ int cmd_rxtest (int argc, char* argv[])
 
 	run_time = ((double)timestampdiff(&stop_time, &start_time)) / ((double)SECOND);
 	TX4("\n%db %.2fs %.2fbps\n", byte_count, run_time, ((double)byte_count * 8) / run_time);
+	if (serial_txdropped())
+		TX2("Dropped: %u\n", serial_txdropped());
 
 	return ERR_OK;
 }
@@ -413,6 +647,8 @@ int cmd_txtest (int argc, char* argv[])
 
 	byte_count += (byte_count / 50) * 7; // Compensate for line header and LF
 	TX4("\n%db %.2fs %.2fbps\n", byte_count, run_time, ((double)byte_count * 8) / run_time);
+	if (serial_txdropped())
+		TX2("Dropped: %u\n", serial_txdropped());
 
 	return ERR_OK;
 }
@@ -16,7 +16,11 @@
 #  include "../common/prot_inc.h"
 #endif
 
-#define LINEBUFFER_MAX	(20)	/* Maximum length of a complete command line */
+#ifdef _16F1939
+#  define LINEBUFFER_MAX	(48)	/* Maximum length of a complete command line */
+#else
+#  define LINEBUFFER_MAX	(20)	/* Maximum length of a complete command line */
+#endif
 #define COMMAND_MAX	(8)	/* Maximum length of a command name */
 #define ARGS_MAX	(4)	/* Maximum number of arguments, including command */
 
@@ -24,6 +28,7 @@
 #define ERR_SYNTAX	(-1)
 #define ERR_IO		(-2)
 #define ERR_PARAM	(-3)
+#define ERR_ABORT	(-4)	/* Reported already, ends the batch */
 
 struct command {
 	char	cmd[COMMAND_MAX];
@@ -33,6 +38,7 @@ struct command {
 /* Generic */
 PUBLIC_FN(void cmdline_init (void));
 PUBLIC_FN(void cmdline_work (void));
+PUBLIC_FN(unsigned char cmdline_busy (void));
 
 /* Command implementations */
 PUBLIC_FN(int cmd_echo   (int argc, char* argv[]));
@@ -49,5 +55,8 @@ PUBLIC_FN(int cmd_setup  (int argc, char* argv[]));
 PUBLIC_FN(int cmd_lock   (int argc, char* argv[]));
 PUBLIC_FN(int cmd_cart   (int argc, char* argv[]));
 #endif
+#ifdef HAS_COMMANDLINE_MACRO
+PUBLIC_FN(int cmd_macro  (int argc, char* argv[]));
+#endif
 
 #endif // !CMDLINE_H
\ No newline at end of file
@@ -6,50 +6,354 @@
 
 #define EVENTLOG_C
 
+#include <htc.h>
 #include <string.h>
 #include <stdio.h>
+#include "../common/hardware.h"
 #include "../common/eventlog.h"
 #include "../common/cmdline.h"
 #include "../common/serial.h"
+#include "../common/frame.h"
+#include "../common/timer.h"
+
+// Longest event line: "<e i=22 v=65535 />\n"
+#define EVENTLOG_LINE_MAX	19
+
+#ifdef HAS_FRAMING
+// While framing, changes go out as telemetry frames instead:
+//   FRAME_EVENT:    seq, ticks since the previous frame (3 bytes), item,
+//                   value (1 byte if it fits, else 2)
+//   FRAME_KEYFRAME: seq, ticks (4 bytes), all EVENTLOG_MAX values (2 bytes)
+// Multi-byte fields are MSB first, ticks are timer ticks (SECOND per second).
+// seq counts frames, plus changes superseded before they could be sent, so
+// the host can tell it missed something. The keyframe resynchronizes the
+// host, and lets it keep the time beyond the 24 bits of an event frame.
+#define EVENTLOG_KEYFRAME_INTERVAL	(10 * SECOND)
+#define EVENTLOG_EVENT_LENGTH		7
+#define EVENTLOG_KEYFRAME_LENGTH	(1 + 4 + 2 * EVENTLOG_MAX)
+#define EVENTLOG_DELTA_MAX		0x00FFFFFFUL
+// Room to check for, as frame.c escapes bytes on the way
+#define EVENTLOG_ROOM			(frame_active() ? FRAME_SIZE_MAX(EVENTLOG_EVENT_LENGTH) : EVENTLOG_LINE_MAX)
+#else
+#define EVENTLOG_ROOM			EVENTLOG_LINE_MAX
+#endif
+
+// The last changes are kept in a ring, whatever the host does, and saved to
+// NVM_EVENTS when an error occurs: event, argument, number of records, then
+// per record, oldest first: age in 0.1 s before the error (2 bytes), item and
+// value (2 bytes), MSB first. The event byte is written last, and 0xFF until
+// then, so a snapshot cut short by a power failure doesn't show.
+#define EVENTLOG_RING			8
+#define EVENTLOG_SNAP_HEADER		3
+#define EVENTLOG_SNAP_RECORD		5
+#define EVENTLOG_SNAP_SIZE		(EVENTLOG_SNAP_HEADER + EVENTLOG_RING * EVENTLOG_SNAP_RECORD)
+#define EVENTLOG_SNAP_NONE		0xFF
+#define EVENTLOG_TENTH			(SECOND / 10)
+
+#if (EVENTLOG_SNAP_SIZE > NVM_EVENTS_SIZE)
+#  error Event ring too big for its EEPROM snapshot!
+#endif
+
+typedef struct {
+	_U32	ticks;
+	_U08	index;
+	_U16	value;
+} eventlog_record_t;
 
 static BOOL eventlog_tracking = false;
+static _U16 eventlog_dropped = 0;	// Changes the host never got to see
+static _U32 eventlog_pending = 0;	// Changes still to send, for lack of room
+#ifdef HAS_FRAMING
+static _U08 eventlog_seq = 0;
+static struct timer eventlog_sent = EXPIRED;		// Time of the last frame
+static struct timer eventlog_keyframe = EXPIRED;	// Time of the last keyframe
+#endif
+
+// The state is packed, each item taking only the bits its values need. This
+// table holds the bit offset of each item, its width being the distance to
+// the next one. Booleans take a single bit, anything wider than its item is
+// cut off, so the widths must cover the values each item is tracked with.
+#define EVENTLOG_BITS	105
+static const _U08 eventlog_offset[EVENTLOG_MAX + 1] = {
+	0,			// EVENTLOG_BOWL: 2 bits, mode
+	2,			// EVENTLOG_ARM: 16 bits, % deployed and mode
+	18, 19, 20, 21,		// EVENTLOG_DOSAGE .. EVENTLOG_TAP: 1 bit
+	22, 23, 24, 25, 26,	// EVENTLOG_WET_SENSOR .. EVENTLOG_CAT_SENSOR: 1 bit
+	27, 28, 29, 30,		// EVENTLOG_LED: 1 bit
+	31, 39, 47, 55, 63, 71,	// EVENTLOG_PACER: 8 bits, pattern
+	79,			// EVENTLOG_WATER_SENSOR: 10 bits, ADC
+	89,			// EVENTLOG_LL_ADDR: 16 bits
+	EVENTLOG_BITS
+};
+
+// Items are accessed through a 3-byte window, which may reach 2 bytes beyond
+// the last item
+static _U08 eventlog_state[(EVENTLOG_BITS + 7) / 8 + 2];
+
+static eventlog_record_t eventlog_ring[EVENTLOG_RING];
+static _U08 eventlog_ring_head = 0;	// Next record to fill
+static _U08 eventlog_ring_count = 0;
+static _U08 eventlog_snap_step = 0;	// Snapshot byte to save next, 0 when done
+static _U08 eventlog_snap_event;
+static _U08 eventlog_snap_argument;
+static _U32 eventlog_snap_ticks;
+
+static _U32 eventlog_ticks(struct timer *t)
+{
+	return ((_U32)t->overflows << 16) | t->timer1;
+}
+
+static _U32 eventlog_window(_U08 *p)
+{
+	return p[0] | ((_U32)p[1] << 8) | ((_U32)p[2] << 16);
+}
+
+static _U16 eventlog_mask(_U08 index)
+{
+	return (_U16)(((_U32)1 << (eventlog_offset[index + 1] - eventlog_offset[index])) - 1);
+}
+
+static _U16 eventlog_get(_U08 index)
+{
+	_U08 offset = eventlog_offset[index];
+
+	return (_U16)(eventlog_window(&eventlog_state[offset >> 3]) >> (offset & 7)) & eventlog_mask(index);
+}
 
-// TBD: Compress the memory for this
-static _U16 eventlog_state[EVENTLOG_MAX];
+static _U16 eventlog_age(_U32 then, _U32 now)
+{
+	_U32 age = (now - then) / EVENTLOG_TENTH;
+
+	return (age > 0xFFFF) ? 0xFFFF : (_U16)age;
+}
 
+// Record n of the ring, the oldest being 0
+static eventlog_record_t *eventlog_record(_U08 n)
+{
+	return &eventlog_ring[(eventlog_ring_head + EVENTLOG_RING - eventlog_ring_count + n) % EVENTLOG_RING];
+}
+
+static _U08 eventlog_snap_byte(_U08 pos)
+{
+	eventlog_record_t *record;
+	_U16 age;
+
+	if (pos == 0) return eventlog_snap_event;
+	if (pos == 1) return eventlog_snap_argument;
+	if (pos == 2) return eventlog_ring_count;
+
+	pos -= EVENTLOG_SNAP_HEADER;
+	record = eventlog_record(pos / EVENTLOG_SNAP_RECORD);
+	age = eventlog_age(record->ticks, eventlog_snap_ticks);
+	switch (pos % EVENTLOG_SNAP_RECORD) {
+	case 0:  return (_U08)(age >> 8);
+	case 1:  return (_U08)age;
+	case 2:  return record->index;
+	case 3:  return (_U08)(record->value >> 8);
+	default: return (_U08)record->value;
+	}
+}
+
+// Saves a byte of the snapshot per pass, only when the EEPROM is ready
+static void eventlog_snap_work(void)
+{
+	_U08 size = EVENTLOG_SNAP_HEADER + eventlog_ring_count * EVENTLOG_SNAP_RECORD;
+
+	if (!eventlog_snap_step || WR) return;
+
+	if (eventlog_snap_step == 1)
+		eeprom_write(NVM_EVENTS, EVENTLOG_SNAP_NONE);
+	else if (eventlog_snap_step < size + 1)
+		eeprom_write(NVM_EVENTS + eventlog_snap_step - 1, eventlog_snap_byte(eventlog_snap_step - 1));
+	else {
+		eeprom_write(NVM_EVENTS, eventlog_snap_event);
+		eventlog_snap_step = 0;
+		return;
+	}
+	eventlog_snap_step++;
+}
+
+static void eventlog_putu(_U16 value)
+{
+	char	digits[5];
+	_U08	n = 0;
+
+	do {
+		digits[n++] = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+	while (n) putch(digits[--n]);
+}
+
+static void eventlog_puts(const char *s)
+{
+	while (*s) putch(*s++);
+}
+
+#ifdef HAS_FRAMING
+static void eventlog_put_ticks(struct timer *now)
+{
+	_U32 ticks = eventlog_ticks(now);
+
+	frame_put((_U08)(ticks >> 24));
+	frame_put((_U08)(ticks >> 16));
+	frame_put((_U08)(ticks >> 8));
+	frame_put((_U08)ticks);
+}
+
+static void eventlog_write_frame(_U08 index, _U16 value)
+{
+	struct timer now;
+	_U32 delta;
+
+	gettimestamp(&now);
+	delta = timestampdiff(&now, &eventlog_sent);
+	if (delta > EVENTLOG_DELTA_MAX) delta = EVENTLOG_DELTA_MAX;
+	eventlog_sent = now;
+
+	frame_begin(FRAME_EVENT, (value > 0xFF) ? EVENTLOG_EVENT_LENGTH : EVENTLOG_EVENT_LENGTH - 1);
+	frame_put(eventlog_seq++);
+	frame_put((_U08)(delta >> 16));
+	frame_put((_U08)(delta >> 8));
+	frame_put((_U08)delta);
+	frame_put(index);
+	if (value > 0xFF) frame_put((_U08)(value >> 8));
+	frame_put((_U08)value);
+	frame_end();
+}
+
+static void eventlog_write_keyframe(void)
+{
+	gettimestamp(&eventlog_sent);
+	eventlog_keyframe = eventlog_sent;
+	// The keyframe carries the latest of everything
+	eventlog_pending = 0;
+
+	frame_begin(FRAME_KEYFRAME, EVENTLOG_KEYFRAME_LENGTH);
+	frame_put(eventlog_seq++);
+	eventlog_put_ticks(&eventlog_sent);
+	for (_U08 i=0; i<EVENTLOG_MAX; i++) {
+		_U16 value = eventlog_get(i);
+
+		frame_put((_U08)(value >> 8));
+		frame_put((_U08)value);
+	}
+	frame_end();
+}
+#endif
+
+// Formatted by hand, printf() takes longer than sending the line
 static void eventlog_write(_U08 index, _U16 value)
 {
-	TX3("<e i=%u v=%u />\n", index, value);
+#ifdef HAS_FRAMING
+	if (frame_active()) {
+		eventlog_write_frame(index, value);
+		return;
+	}
+#endif
+	eventlog_puts("<e i=");
+	eventlog_putu(index);
+	eventlog_puts(" v=");
+	eventlog_putu(value);
+	eventlog_puts(" />\n");
 }
 
 void eventlog_init(void)
 {
-	for (_U08 i=0; i<EVENTLOG_MAX; i++) eventlog_state[i] = 0;
+	for (_U08 i=0; i<sizeof(eventlog_state); i++) eventlog_state[i] = 0;
 }
 
 void eventlog_work(void)
 {
-	// Nothing to do
+	eventlog_snap_work();
+
+#ifdef HAS_FRAMING
+	if (eventlog_tracking && frame_active()) {
+		struct timer now;
+
+		gettimestamp(&now);
+		if ((timestampdiff(&now, &eventlog_keyframe) >= EVENTLOG_KEYFRAME_INTERVAL) &&
+		    (serial_txfree() >= FRAME_SIZE_MAX(EVENTLOG_KEYFRAME_LENGTH)))
+			eventlog_write_keyframe();
+	}
+#endif
+
+	// Send the latest value of items that didn't fit before
+	for (_U08 i=0; eventlog_pending && (i<EVENTLOG_MAX); i++) {
+		if (!(eventlog_pending & ((_U32)1 << i))) continue;
+		if (serial_txfree() < EVENTLOG_ROOM) return;
+		eventlog_pending &= ~((_U32)1 << i);
+		eventlog_write(i, eventlog_get(i));
+	}
 }
 
 void eventlog_track(_U08 index, _U16 value)
 {
+	_U08 offset = eventlog_offset[index];
+	_U08 *p = &eventlog_state[offset >> 3];
+	_U16 mask = eventlog_mask(index);
+	_U32 changed;
+
+	if ((mask == 1) && value) value = 1;
+	value &= mask;
+
 	// If value didn't change there's nothing to track
-	if (value == eventlog_state[index]) return;
+	changed = ((eventlog_window(p) >> (offset & 7)) ^ value) & mask;
+	if (!changed) return;
+
+	// Flip the changed bits in place
+	changed <<= (offset & 7);
+	p[0] ^= (_U08)changed;
+	p[1] ^= (_U08)(changed >> 8);
+	p[2] ^= (_U08)(changed >> 16);
 
-	// Log event & Update
-	if (eventlog_tracking) eventlog_write(index, value);
-	eventlog_state[index] = value;
+	// Keep it for a snapshot, unless one is being saved
+	if (!eventlog_snap_step) {
+		struct timer now;
+
+		gettimestamp(&now);
+		eventlog_ring[eventlog_ring_head].ticks = eventlog_ticks(&now);
+		eventlog_ring[eventlog_ring_head].index = index;
+		eventlog_ring[eventlog_ring_head].value = value;
+		eventlog_ring_head = (eventlog_ring_head + 1) % EVENTLOG_RING;
+		if (eventlog_ring_count < EVENTLOG_RING) eventlog_ring_count++;
+	}
+
+	// Log event & Update, but rather defer it than wait for the transmitter
+	if (eventlog_tracking) {
+		if (eventlog_pending & ((_U32)1 << index)) {
+			// Still waiting to send the previous change, which is lost now
+			if (eventlog_dropped < 0xFFFF) eventlog_dropped++;
+#ifdef HAS_FRAMING
+			eventlog_seq++;
+#endif
+		} else if (serial_txfree() >= EVENTLOG_ROOM)
+			eventlog_write(index, value);
+		else
+			eventlog_pending |= ((_U32)1 << index);
+	}
 }
 
 void eventlog_start()
 {
 	// - Go ahead and re-send event info if requested - if (eventlog_tracking) return;
 	eventlog_tracking = true;
+	eventlog_dropped = 0;
+	eventlog_pending = 0;
 	
+#ifdef HAS_FRAMING
+	if (frame_active()) {
+		eventlog_write_keyframe();
+		return;
+	}
+#endif
+
 	//TX("<l n=e>\n");
-	for (_U08 i=0; i<EVENTLOG_MAX; i++)
-		if (eventlog_state[i] != 0) eventlog_write(i, eventlog_state[i]);
+	for (_U08 i=0; i<EVENTLOG_MAX; i++) {
+		_U16 value = eventlog_get(i);
+
+		if (value != 0) eventlog_write(i, value);
+	}
 	//TX("</l>\n");
 }
 
@@ -58,12 +362,64 @@ void eventlog_stop()
 	eventlog_tracking = false;
 }
 
+void eventlog_snapshot(_U08 event, _U08 argument)
+{
+	struct timer now;
+
+	// The first error is the interesting one
+	if (eventlog_snap_step) return;
+
+	gettimestamp(&now);
+	eventlog_snap_ticks = eventlog_ticks(&now);
+	eventlog_snap_event = event;
+	eventlog_snap_argument = argument;
+	eventlog_snap_step = 1;
+}
+
+_U08 eventlog_busy(void)
+{
+	return (eventlog_snap_step != 0);
+}
+
+static void eventlog_dump(void)
+{
+	struct timer now;
+	_U08 count = eeprom_read(NVM_EVENTS + 2);
+	_U08 address;
+
+	if ((eeprom_read(NVM_EVENTS) == EVENTLOG_SNAP_NONE) || (count > EVENTLOG_RING))
+		TX("Snapshot: none\n");
+	else {
+		TX3("Snapshot: error %u (%u)\n", eeprom_read(NVM_EVENTS), eeprom_read(NVM_EVENTS + 1));
+		for (address = NVM_EVENTS + EVENTLOG_SNAP_HEADER;
+		     count--;
+		     address += EVENTLOG_SNAP_RECORD)
+			TX4("<e i=%u v=%u t=-%u />\n",
+			    eeprom_read(address + 2),
+			    ((_U16)eeprom_read(address + 3) << 8) | eeprom_read(address + 4),
+			    ((_U16)eeprom_read(address) << 8) | eeprom_read(address + 1));
+	}
+
+	// Ages in 0.1 s before the error, or before now
+	gettimestamp(&now);
+	TX("Recent:\n");
+	for (_U08 i=0; i<eventlog_ring_count; i++)
+		TX4("<e i=%u v=%u t=-%u />\n",
+		    eventlog_record(i)->index,
+		    eventlog_record(i)->value,
+		    eventlog_age(eventlog_record(i)->ticks, eventlog_ticks(&now)));
+}
+
 int cmd_evt(int argc, char* argv[])
 {
 	if (argc > 2) return ERR_SYNTAX;
 
 	if (argc == 2)
 	{
+		if (!stricmp(argv[1], "dump")) {
+			eventlog_dump();
+			return ERR_OK;
+		}
 		if (stricmp(argv[1], "on"))
 			eventlog_stop();
 		else
@@ -71,6 +427,7 @@ int cmd_evt(int argc, char* argv[])
 	}
 
 	TX2("Event: %s\n", eventlog_tracking ? "on" : "off");
+	if (eventlog_dropped) TX2("Dropped: %u\n", eventlog_dropped);
 
 	return ERR_OK;
 }
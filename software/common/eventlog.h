@@ -37,6 +37,8 @@ PUBLIC_FN(void eventlog_work(void));
 PUBLIC_FN(void eventlog_track(_U08 item, _U16 value));
 PUBLIC_FN(void eventlog_start(void));
 PUBLIC_FN(void eventlog_stop(void));
+PUBLIC_FN(void eventlog_snapshot(_U08 event, _U08 argument));
+PUBLIC_FN(_U08 eventlog_busy(void));
 PUBLIC_FN(int cmd_evt(int argc, char *argv[]));
 
 #else
@@ -44,6 +46,8 @@ PUBLIC_FN(int cmd_evt(int argc, char *argv[]));
 #define eventlog_init()
 #define eventlog_work()
 #define eventlog_track(x, y)
+#define eventlog_snapshot(e, a)
+#define eventlog_busy()		0
 
 #endif
 
@@ -0,0 +1,423 @@
+/******************************************************************************/
+/* File    :	frame.c							      */
+/* Function:	Binary framed host protocol				      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+#include "../common/app_prefs.h"
+
+#ifdef HAS_FRAMING
+
+#include <htc.h>
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "frame.h"
+#include "serial.h"
+#include "timer.h"
+#include "srix4k.h"
+#include "eventlog.h"
+
+#ifdef APP_CATGENIUS
+#include "../catgenius/litterlanguage.h"
+#include "../catgenius/eepromwashprogram.h"
+#include "../catgenius/rfidwashprogram.h"
+#endif
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+#define ENQ			0x05
+#define ACK			0x06
+#define DLE			0x10
+#define XON			0x11
+#define XOFF			0x13
+
+/* Escaped bytes go out as DLE and the byte with ESCAPE_BIT flipped */
+#define ESCAPE_BIT		0x20
+#define ESCAPED(b)		(((b) == FRAME_SOH) || ((b) == DLE) || \
+				 ((b) == XON) || ((b) == XOFF))
+
+#define CRC_INIT		0xFFFF
+#define CRC_POLY		0x1021
+
+/* A frame cut short is dropped once the line has been quiet this long */
+#define FRAME_GAP		(100 * MILISECOND)
+
+#define STATE_SOH		0	/* Between frames */
+#define STATE_LENGTH		1
+#define STATE_TYPE		2
+#define STATE_PAYLOAD		3
+#define STATE_CRC_MSB		4
+#define STATE_CRC_LSB		5
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+bit				frame_mode	= 0;	/* Framing on */
+
+static unsigned char		state		= STATE_SOH;
+static unsigned char		rx_length;
+static unsigned char		rx_type;
+static unsigned char		rx_count;
+static unsigned short		rx_crc;
+static bit			rx_escaped	= 0;
+static unsigned char		rx_payload[FRAME_PAYLOAD_MAX];
+static struct timer		rx_last		= EXPIRED;
+static unsigned short		tx_crc;
+
+/* Text printed in between frames, sent as FRAME_LOG per line */
+static unsigned char		log_line[FRAME_PAYLOAD_MAX];
+static unsigned char		log_length	= 0;
+
+#ifdef HAS_EEPROMPROGRAM
+/* FRAME_PROG_WRITE is replied to once its bytes are written */
+static bit			prog_reply	= 0;
+static unsigned char		prog_end;
+#endif /* HAS_EEPROMPROGRAM */
+
+#ifdef HAS_SRIX4K
+static unsigned char		tag_block;
+static unsigned char		tag_left	= 0;	/* Blocks still to send */
+#endif /* HAS_SRIX4K */
+
+
+/******************************************************************************/
+/* Local Prototypes							      */
+/******************************************************************************/
+
+static unsigned short	crc16			(unsigned short		crc,
+						 unsigned char		byte);
+static unsigned short	put			(unsigned short		crc,
+						 unsigned char		byte);
+static void		nak			(unsigned char		type,
+						 unsigned char		error);
+static void		handle			(void);
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+void frame_work (void)
+/******************************************************************************/
+/* Function:	frame_work						      */
+/*		- Replies to FRAME_PROG_WRITE once its bytes are written      */
+/*		- Sends the tag blocks requested by FRAME_TAG_READ as the     */
+/*		  reader delivers them, one block at a time		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+#ifdef HAS_SRIX4K
+	unsigned char	data[1 + SRIX4K_BLOCKSIZE];
+#endif /* HAS_SRIX4K */
+
+#ifdef HAS_EEPROMPROGRAM
+	if (prog_reply && !eepromwashprogram_busy()) {
+		frame_tx(FRAME_PROG_WRITE | FRAME_REPLY, &prog_end, 1);
+		prog_reply = 0;
+	}
+#endif /* HAS_EEPROMPROGRAM */
+
+#ifdef HAS_SRIX4K
+	if (!tag_left)
+		return;
+
+	switch (srix4k_status()) {
+	case SRIX4K_BUSY:
+		return;
+	case SRIX4K_OK:
+		data[0] = srix4k_data(&data[1]);
+		frame_tx(FRAME_TAG_READ | FRAME_REPLY, data, sizeof(data));
+		if (--tag_left)
+			srix4k_read(++tag_block);
+		break;
+	default:
+		nak(FRAME_TAG_READ, FRAME_ERR_IO);
+		tag_left = 0;
+	}
+#endif /* HAS_SRIX4K */
+}
+/* frame_work */
+
+unsigned char frame_busy (void)
+{
+#ifdef HAS_EEPROMPROGRAM
+	if (prog_reply)
+		return 1;
+#endif /* HAS_EEPROMPROGRAM */
+#ifdef HAS_SRIX4K
+	return (tag_left != 0);
+#else
+	return 0;
+#endif /* HAS_SRIX4K */
+}
+
+
+void frame_open (void)
+{
+	frame_mode = 1;
+	state = STATE_SOH;
+	log_length = 0;
+}
+
+void frame_rx (char ch)
+/******************************************************************************/
+/* Function:	frame_rx						      */
+/*		- Assembles a frame from the received characters and handles  */
+/*		  it once its CRC checks out. The CRC is run over the CRC     */
+/*		  bytes as well, which leaves 0 for an intact frame. SOH is   */
+/*		  escaped within frames, so it always starts a new one	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	byte = (unsigned char)ch;
+	struct timer	now;
+
+	gettimestamp(&now);
+	if ((state != STATE_SOH) && (timestampdiff(&now, &rx_last) > FRAME_GAP))
+		state = STATE_SOH;
+	rx_last = now;
+
+	if (byte == FRAME_SOH) {
+		rx_crc = CRC_INIT;
+		rx_escaped = 0;
+		state = STATE_LENGTH;
+		return;
+	}
+	if (state == STATE_SOH) {
+		if (byte == ENQ)
+			/* Still there, also while framing */
+			serial_put(ACK);
+		/* Anything else is noise */
+		return;
+	}
+	if (byte == DLE) {
+		rx_escaped = 1;
+		return;
+	}
+	if (rx_escaped) {
+		byte ^= ESCAPE_BIT;
+		rx_escaped = 0;
+	}
+
+	switch (state) {
+	case STATE_LENGTH:
+		if (byte > FRAME_PAYLOAD_MAX) {
+			state = STATE_SOH;
+			return;
+		}
+		rx_length = byte;
+		rx_count = 0;
+		state = STATE_TYPE;
+		break;
+	case STATE_TYPE:
+		rx_type = byte;
+		state = rx_length ? STATE_PAYLOAD : STATE_CRC_MSB;
+		break;
+	case STATE_PAYLOAD:
+		rx_payload[rx_count++] = byte;
+		if (rx_count >= rx_length)
+			state = STATE_CRC_MSB;
+		break;
+	case STATE_CRC_MSB:
+		state = STATE_CRC_LSB;
+		break;
+	case STATE_CRC_LSB:
+		state = STATE_SOH;
+		if (crc16(rx_crc, byte))
+			nak(rx_type, FRAME_ERR_CRC);
+		else
+			handle();
+		return;
+	}
+	rx_crc = crc16(rx_crc, byte);
+}
+/* frame_rx */
+
+void frame_tx (unsigned char type, const unsigned char *payload, unsigned char length)
+{
+	frame_begin(type, length);
+	while (length--)
+		frame_put(*payload++);
+	frame_end();
+}
+
+/* Frames too big for a buffer are sent a byte at a time, from begin to end */
+void frame_begin (unsigned char type, unsigned char length)
+{
+	serial_put(FRAME_SOH);
+	tx_crc = put(CRC_INIT, length);
+	tx_crc = put(tx_crc, type);
+}
+
+void frame_put (unsigned char byte)
+{
+	tx_crc = put(tx_crc, byte);
+}
+
+void frame_end (void)
+{
+	put(0, (unsigned char)(tx_crc >> 8));
+	put(0, (unsigned char)tx_crc);
+}
+
+void frame_text (char ch)
+{
+	/* Raw text would throw the host off, so it goes out per line */
+	if (ch != '\n')
+		log_line[log_length++] = (unsigned char)ch;
+	if ((ch == '\n') || (log_length >= sizeof(log_line))) {
+		frame_tx(FRAME_LOG, log_line, log_length);
+		log_length = 0;
+	}
+}
+
+
+/******************************************************************************/
+/* Local Implementations						      */
+/******************************************************************************/
+
+static unsigned short crc16 (unsigned short crc, unsigned char byte)
+{
+	unsigned char	bits;
+
+	crc ^= (unsigned short)byte << 8;
+	for (bits = 0; bits < 8; bits++)
+		if (crc & 0x8000)
+			crc = (crc << 1) ^ CRC_POLY;
+		else
+			crc <<= 1;
+	return crc;
+}
+
+static unsigned short put (unsigned short crc, unsigned char byte)
+{
+	/* Keep SOH for frame starts, and Xon/Xoff for flow control */
+	if (ESCAPED(byte)) {
+		serial_put(DLE);
+		serial_put((char)(byte ^ ESCAPE_BIT));
+	} else
+		serial_put((char)byte);
+	return crc16(crc, byte);
+}
+
+static void nak (unsigned char type, unsigned char error)
+{
+	unsigned char	payload[2];
+
+	payload[0] = type;
+	payload[1] = error;
+	frame_tx(FRAME_NAK, payload, sizeof(payload));
+}
+
+static void handle (void)
+/******************************************************************************/
+/* Function:	handle							      */
+/*		- Carries out a request and replies to it. Replies that take  */
+/*		  a while, like tag blocks, are sent by frame_work()	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	index;
+	unsigned char	offset;
+	unsigned char	count;
+
+	switch (rx_type) {
+	case FRAME_PING:
+		if (rx_length)
+			break;
+		rx_payload[0] = FRAME_VERSION;
+		rx_payload[1] = FRAME_PAYLOAD_MAX;
+		frame_tx(FRAME_PING | FRAME_REPLY, rx_payload, 2);
+		return;
+
+	case FRAME_TEXT:
+		if (rx_length)
+			break;
+		frame_tx(FRAME_TEXT | FRAME_REPLY, rx_payload, 0);
+		frame_mode = 0;
+		return;
+
+#ifdef HAS_EVENTLOG
+	case FRAME_EVENTS:
+		if (rx_length != 1)
+			break;
+		frame_tx(FRAME_EVENTS | FRAME_REPLY, rx_payload, 0);
+		if (rx_payload[0])
+			eventlog_start();
+		else
+			eventlog_stop();
+		return;
+#endif /* HAS_EVENTLOG */
+
+#ifdef HAS_EEPROMPROGRAM
+	case FRAME_PROG_READ:
+		if ((rx_length != 2) ||
+		    (rx_payload[1] > FRAME_PAYLOAD_MAX) ||
+		    ((unsigned int)rx_payload[0] + rx_payload[1] > NVM_PROGRAM_SIZE))
+			break;
+		/* The data replaces the request */
+		offset = rx_payload[0];
+		count = rx_payload[1];
+		for (index = 0; index < count; index++)
+			rx_payload[index] = eeprom_read(NVM_PROGRAM + offset + index);
+		frame_tx(FRAME_PROG_READ | FRAME_REPLY, rx_payload, count);
+		return;
+
+	case FRAME_PROG_WRITE:
+		if ((rx_length < 1) ||
+		    ((unsigned int)rx_payload[0] + rx_length - 1 > NVM_PROGRAM_SIZE))
+			break;
+		if (rx_length == 1) {
+			frame_tx(FRAME_PROG_WRITE | FRAME_REPLY, rx_payload, 1);
+			return;
+		}
+		/* Refused while running, or while a write is in progress */
+		if (prog_reply ||
+		    !eepromwashprogram_write(rx_payload[0], &rx_payload[1],
+					     rx_length - 1)) {
+			nak(FRAME_PROG_WRITE, FRAME_ERR_BUSY);
+			return;
+		}
+		prog_end = rx_payload[0] + rx_length - 1;
+		prog_reply = 1;
+		return;
+#endif /* HAS_EEPROMPROGRAM */
+
+#ifdef HAS_SRIX4K
+	case FRAME_TAG_READ:
+		if ((rx_length != 2) || !rx_payload[1] ||
+		    ((unsigned int)rx_payload[0] + rx_payload[1] > 0x100))
+			break;
+		/* The reader is shared with a program running from the tag */
+		if (tag_left || litterlanguage_running() ||
+#ifdef HAS_RFIDPROGRAM
+		    rfidwashprogram_busy() ||
+#endif /* HAS_RFIDPROGRAM */
+		    !srix4k_read(rx_payload[0])) {
+			nak(FRAME_TAG_READ, FRAME_ERR_BUSY);
+			return;
+		}
+		tag_block = rx_payload[0];
+		tag_left = rx_payload[1];
+		return;
+#endif /* HAS_SRIX4K */
+
+	default:
+		nak(rx_type, FRAME_ERR_TYPE);
+		return;
+	}
+
+	nak(rx_type, FRAME_ERR_PARAM);
+}
+/* handle */
+
+#endif /* HAS_FRAMING */
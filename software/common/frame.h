@@ -0,0 +1,75 @@
+/******************************************************************************/
+/* File    :	frame.h							      */
+/* Function:	Include file of 'frame.c'.				      */
+/******************************************************************************/
+
+#ifndef FRAME_H				/* Include file already compiled? */
+#define FRAME_H
+
+#include "../common/app_prefs.h"
+
+#ifdef HAS_FRAMING
+
+/*
+ * A frame is SOH, payload length, type, payload and a CRC-16/CCITT (MSB
+ * first) over length, type and payload. After the SOH, the bytes SOH, DLE,
+ * Xon and Xoff are sent as DLE and the byte XOR 0x20, so flow control
+ * keeps working. Framing starts with a frame sent right after the ENQ/ACK
+ * handshake, and ends with FRAME_TEXT.
+ */
+#define FRAME_SOH		0x01
+#define FRAME_PAYLOAD_MAX	32
+#define FRAME_VERSION		1
+
+/* Room a frame takes on the line at most, with every byte escaped */
+#define FRAME_SIZE_MAX(length)	(1 + 2 * (2 + (length) + 2))
+
+/* Requests, answered with their type | FRAME_REPLY or with FRAME_NAK */
+#define FRAME_PING		0x00	/* -> [version, payload max] */
+#define FRAME_TEXT		0x01	/* Back to the text command line */
+#define FRAME_EVENTS		0x02	/* [on] */
+#define FRAME_PROG_READ		0x10	/* [offset, count] -> [data...] */
+#define FRAME_PROG_WRITE	0x11	/* [offset, data...] -> [next offset], once written */
+#define FRAME_TAG_READ		0x20	/* [block, count] -> [block, data x4] each */
+
+/* Sent by the device */
+#define FRAME_REPLY		0x80
+#define FRAME_LOG		0xC0	/* [text], a line printed meanwhile */
+#define FRAME_EVENT		0xC1	/* See eventlog.c */
+#define FRAME_KEYFRAME		0xC2	/* See eventlog.c */
+#define FRAME_NAK		0xFF	/* [request type, error] */
+
+/* Errors in FRAME_NAK */
+#define FRAME_ERR_CRC		0x01
+#define FRAME_ERR_TYPE		0x02
+#define FRAME_ERR_PARAM		0x03
+#define FRAME_ERR_BUSY		0x04
+#define FRAME_ERR_IO		0x05
+
+extern bit	frame_mode;
+
+/* Generic */
+void		frame_work		(void) ;
+unsigned char	frame_busy		(void) ;
+
+/* Control */
+void		frame_open		(void) ;
+void		frame_rx		(char				  ch) ;
+void		frame_tx		(unsigned char			  type,
+					 const unsigned char		* payload,
+					 unsigned char			  length) ;
+void		frame_begin		(unsigned char			  type,
+					 unsigned char			  length) ;
+void		frame_put		(unsigned char			  byte) ;
+void		frame_end		(void) ;
+void		frame_text		(char				  ch) ;
+
+#define frame_active()		(frame_mode)
+
+#else /* !HAS_FRAMING */
+
+#define frame_active()		0
+
+#endif /* HAS_FRAMING */
+
+#endif /* FRAME_H */
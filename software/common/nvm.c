@@ -0,0 +1,233 @@
+/******************************************************************************/
+/* File    :	nvm.c							      */
+/* Function:	Wear-leveled journal of the non-volatile settings	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+#include "../common/app_prefs.h"
+
+#ifdef HAS_NVMJOURNAL
+
+#include <htc.h>
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "nvm.h"
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+/*
+ * Every change of a setting is appended to a ring of two-byte records:
+ * the tag, with a 4-bit sequence number in the high nibble and the NVM_*
+ * key in the low one, followed by the value. The sequence runs on from
+ * record to record, so the newest record is the last one before the
+ * sequence breaks. The ring size must not be a multiple of 16, or a full
+ * ring would not break at all.
+ */
+#define RECORD_SIZE		2
+#define RECORDS			(NVM_JOURNAL_SIZE / RECORD_SIZE)
+
+#define TAG(seq, key)		((unsigned char)(((seq) << 4) | (key)))
+#define TAG_SEQ(tag)		((tag) >> 4)
+#define TAG_KEY(tag)		((tag) & 0x0F)
+#define SEQ_MASK		0x0F
+
+#define NO_RECORD		0xFF
+#define NO_KEY			0xFF
+
+#if (NVM_KEYS > 15)
+#  error Too many keys for the journal tag!
+#endif
+#if ((RECORDS % 16) == 0)
+#  error Journal size is a multiple of the sequence range!
+#endif
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+static unsigned char		values[NVM_KEYS];	/* Current settings */
+static unsigned char		records[NVM_KEYS];	/* Record holding each one */
+static unsigned char		head		= 0;	/* Next record to write */
+static unsigned char		seq		= 0;	/* Its sequence number */
+
+/* Write-behind queue: one bit per key, so repeated writes coalesce */
+static unsigned char		dirty		= 0;	/* Keys not journaled yet */
+static unsigned char		pending		= NO_KEY; /* Value written, tag not */
+
+
+/******************************************************************************/
+/* Local Prototypes							      */
+/******************************************************************************/
+
+static unsigned char	live			(unsigned char		record);
+static void		advance			(void);
+static void		write_tag		(unsigned char		key);
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+void nvm_init (void)
+/******************************************************************************/
+/* Function:	nvm_init						      */
+/*		- Restores the settings in a single pass over the journal.    */
+/*		  Records up to the break in the sequence are the newest,     */
+/*		  the ones after it only count for keys not seen before.      */
+/*		  Keys without a record keep the value of their fixed	      */
+/*		  address, as written by firmware without a journal	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	record;
+	unsigned char	tag;
+	unsigned char	last	= NO_RECORD;
+	unsigned char	key;
+	unsigned char	newer	= 0;		/* Keys seen before the break */
+	unsigned char	found	= 0;		/* Break found */
+
+	for (key = 0; key < NVM_KEYS; key++) {
+		values[key] = eeprom_read(key);
+		records[key] = NO_RECORD;
+	}
+
+	head = 0;
+	seq = 0;
+	for (record = 0; record < RECORDS; record++) {
+		tag = eeprom_read(NVM_JOURNAL + record * RECORD_SIZE);
+		key = TAG_KEY(tag);
+		if (key >= NVM_KEYS) {
+			/* Never written */
+			if (!found) {
+				head = record;
+				if (last != NO_RECORD)
+					seq = (TAG_SEQ(last) + 1) & SEQ_MASK;
+				found = 1;
+			}
+			continue;
+		}
+
+		if (!found && (last != NO_RECORD) &&
+		    (TAG_SEQ(tag) != ((TAG_SEQ(last) + 1) & SEQ_MASK))) {
+			/* Oldest record */
+			head = record;
+			seq = (TAG_SEQ(last) + 1) & SEQ_MASK;
+			found = 1;
+		}
+
+		if (!found)
+			newer |= (1 << key);
+		else if (newer & (1 << key))
+			continue;
+		values[key] = eeprom_read(NVM_JOURNAL + record * RECORD_SIZE + 1);
+		records[key] = record;
+		if (!found)
+			last = tag;
+	}
+
+	/* A full ring breaks where it wraps */
+	if (!found && (last != NO_RECORD))
+		seq = (TAG_SEQ(last) + 1) & SEQ_MASK;
+}
+/* nvm_init */
+
+
+unsigned char nvm_read (unsigned char const key)
+{
+	return values[key];
+}
+
+void nvm_write (unsigned char const key, unsigned char const value)
+{
+	if (values[key] == value)
+		return;
+	/* Queued for nvm_work(), the setting is current right away */
+	values[key] = value;
+	dirty |= BIT(key);
+}
+
+void nvm_work (void)
+/******************************************************************************/
+/* Function:	nvm_work						      */
+/*		- Writes one byte of the queued settings to the journal, and  */
+/*		  only once the previous one is done, so the CPU never spins  */
+/*		  on WR. Records still holding the current value of their key */
+/*		  are taken along by rewriting their tag, so the ring never   */
+/*		  drops a setting. The value goes first and the tag last, so  */
+/*		  a write cut short by a power failure leaves a record that   */
+/*		  is either blank or outdated				      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	key;
+
+	if (WR)
+		return;
+
+	if (pending != NO_KEY) {
+		/* Complete the record */
+		write_tag(pending);
+		records[pending] = head;
+		pending = NO_KEY;
+		advance();
+		return;
+	}
+
+	if (!dirty)
+		return;
+
+	for (key = 0; !(dirty & BIT(key)); key++)
+		;
+	if ((records[key] != head) && live(head)) {
+		write_tag(TAG_KEY(eeprom_read(NVM_JOURNAL + head * RECORD_SIZE)));
+		advance();
+		return;
+	}
+
+	/* Changes made from here on make it dirty again */
+	dirty &= ~BIT(key);
+	eeprom_write(NVM_JOURNAL + head * RECORD_SIZE + 1, values[key]);
+	pending = key;
+}
+/* nvm_work */
+
+unsigned char nvm_busy (void)
+{
+	return (dirty || (pending != NO_KEY));
+}
+
+
+/******************************************************************************/
+/* Local Implementations						      */
+/******************************************************************************/
+
+static unsigned char live (unsigned char record)
+{
+	unsigned char	key;
+
+	for (key = 0; key < NVM_KEYS; key++)
+		if (records[key] == record)
+			return 1;
+	return 0;
+}
+
+static void write_tag (unsigned char key)
+{
+	eeprom_write(NVM_JOURNAL + head * RECORD_SIZE, TAG(seq, key));
+}
+
+static void advance (void)
+{
+	if (++head >= RECORDS)
+		head = 0;
+	seq = (seq + 1) & SEQ_MASK;
+}
+
+#endif /* HAS_NVMJOURNAL */
@@ -0,0 +1,34 @@
+/******************************************************************************/
+/* File    :	nvm.h							      */
+/* Function:	Include file of 'nvm.c'.				      */
+/******************************************************************************/
+
+#ifndef NVM_H				/* Include file already compiled? */
+#define NVM_H
+
+#include "../common/app_prefs.h"
+
+#ifdef HAS_NVMJOURNAL
+
+/* Generic */
+void		nvm_init		(void) ;
+void		nvm_work		(void) ;
+unsigned char	nvm_busy		(void) ;
+
+/* Settings, by their NVM_* key */
+unsigned char	nvm_read		(unsigned char		  const key) ;
+void		nvm_write		(unsigned char		  const key,
+					 unsigned char		  const value) ;
+
+#else /* !HAS_NVMJOURNAL */
+
+/* Settings live at their fixed addresses, written in place */
+#define nvm_init()
+#define nvm_work()
+#define nvm_busy()		0
+#define nvm_read(key)		eeprom_read(key)
+#define nvm_write(key, value)	eeprom_write(key, value)
+
+#endif /* HAS_NVMJOURNAL */
+
+#endif /* NVM_H */
@@ -52,6 +52,7 @@ void rtc_init (unsigned char flags)
 /*		- Initial revision.					      */
 /******************************************************************************/
 {
+	timer_register(&second, TIMER_OWNER_RTC);
 	settimeout(&second, SECOND);
 
 	if (flags & POWER_FAILURE) {
@@ -72,7 +73,8 @@ void rtc_work (void)
 /*		- Initial revision.					      */
 /******************************************************************************/
 {
-	if (timeoutexpired(&second)) {
+	if (timer_due(TIMER_OWNER_RTC) &&
+	    timeoutexpired(&second)) {
 		postponetimeout(&second, SECOND);
 		uptime++;
 		if (++currenttime.seconds >= 60) {
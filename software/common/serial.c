@@ -4,34 +4,47 @@
 #include "hardware.h"			/* Flexible hardware configuration */
 
 #include "serial.h"
+#include "frame.h"
 
 
 #define RXBUFFER			/* Use buffers for received characters */
-//#define TXBUFFER			/* Use buffers for transmitted character (MAKE SURE TO ENABLE INTERRUPTS BEFORE TRANSMITTING ANYTHING) */
-#define BUFFER_SIZE		8	/* Buffer size.  Has to be a power of 2 or roll-overs need to be taken into account */
-#define BUFFER_SPARE		2	/* Minumum number of free positions before issuing Xoff */
+#ifdef _16F1939
+#  define RXBUFFER_SIZE		64	/* Power of 2, at most 128 */
+#  define TXBUFFER			/* Use buffers for transmitted character, drained by the tx interrupt */
+#  define TXBUFFER_SIZE		128	/* Power of 2, at most 128 */
+#else
+#  define RXBUFFER_SIZE		8
+#endif /* _16F1939 */
+#define RXBUFFER_XOFF		(RXBUFFER_SIZE - RXBUFFER_SIZE / 4)	/* Queued characters to issue Xoff at */
+#define RXBUFFER_XON		(RXBUFFER_SIZE / 4)			/* Queued characters to issue Xon at again */
 
 #define INTDIV(t,n)		((2*(t)+(n))/(2*(n)))		/* Macro for integer division with proper round-off (BEWARE OF OVERFLOW!) */
-#define FREE(h,t,s)		(((h)>=(t))?((s)-((h)-(t))-1):((t)-(h))-1)
+#define QUEUED(q)		((unsigned char)((q).head - (q).tail))	/* Number of characters in queue 'q' */
 
 #define XON			0x11	/* ASCII value for Xon (^S) */
 #define XOFF			0x13	/* ASCII value for Xoff (^Q) */
 
 
+/* Head and tail run freely, so a full queue uses all positions of its buffer */
 struct queue {
-	char		buffer[BUFFER_SIZE];	/* Here's where the data goes */
-	unsigned	head		: 3;	/* Index to a currently free position in buffer */
-	unsigned	tail		: 3;	/* Index to the oldes occupied position in buffer, if not equal to head */
+	unsigned char	head;			/* Counts characters put in, buffer index in the low bits */
+	unsigned char	tail;			/* Counts characters taken out, buffer index in the low bits */
 	unsigned	xon_enabled	: 1;	/* Specifies if Xon/Xoff should be issued/adhered to */
 	unsigned	xon_state	: 1;	/* Keeps track of current Xon/Xoff state for this queue */
 };
 
 #ifdef RXBUFFER
 struct queue		rx;
+char			rx_buffer[RXBUFFER_SIZE];
 #endif /* RXBUFFER */
 #ifdef TXBUFFER
 struct queue		tx;
+char			tx_buffer[TXBUFFER_SIZE];
+static unsigned short	tx_dropped	= 0;	/* Characters dropped while stopped by Xoff */
 #endif /* TXBUFFER */
+#ifdef _16F1939
+static bit		heard		= 0;	/* Character received since serial_heard() */
+#endif /* _16F1939 */
 
 
 void serial_init(unsigned long bitrate, unsigned char flow)
@@ -95,7 +108,9 @@ void serial_term(void)
 	RCIE = 0;	/* Disable rx interrupt */
 #endif /* RXBUFFER */
 #ifdef TXBUFFER
-	while (tx.head != tx.tail);
+	while (QUEUED(tx))
+		if (TXIF && !GIE)
+			serial_tx_isr();
 	TXIE = 0;	/* Disable tx interrupt */
 #endif /* TXBUFFER */
 
@@ -116,9 +131,11 @@ void serial_term(void)
 void serial_rx_isr(void)
 {
 #ifdef RXBUFFER
+	char	ch;
+
 	/* Handle overflow errors */
 	if (OERR) {
-		rx.buffer[rx.head] = RCREG; /* Read RX register, but do not queue */
+		ch = RCREG; /* Read RX register, but do not queue */
 		TXEN = 0;
 		TXEN = 1;
 		CREN = 0;
@@ -127,46 +144,46 @@ void serial_rx_isr(void)
 	}
 	/* Handle framing errors */
 	if (FERR) {
-		rx.buffer[rx.head] = RCREG; /* Read RX register, but do not queue */
+		ch = RCREG; /* Read RX register, but do not queue */
 		TXEN = 0;
 		TXEN = 1;
 		return;
 	}
-	/* Copy the character from RX register into RX queue */
-	rx.buffer[rx.head] = RCREG;
+	/* Copy the character from RX register */
+	ch = RCREG;
+#ifdef _16F1939
+	heard = 1;
+#endif /* _16F1939 */
 #ifdef TXBUFFER
 	/* Check if an Xon or Xoff needs to be handled */
 	if (tx.xon_enabled) {
-		if (tx.xon_state && (rx.buffer[rx.head] == XOFF)) {
+		if (tx.xon_state && (ch == XOFF)) {
 			tx.xon_state = 0;
 			TXIE = 0;	/* Disable tx interrupt to stop transmitting */
 			return;
-		} else if (!tx.xon_state && (rx.buffer[rx.head] == XON)) {
+		} else if (!tx.xon_state && (ch == XON)) {
 			tx.xon_state = 1;
 			/* Enable tx interrupt if tx queue is not empty */
-			if (tx.head != tx.tail)
+			if (QUEUED(tx))
 				TXIE = 1;
 			return;
 		}
 	}
 #endif /* TXBUFFER */
+	/* On an overflow, keep what's queued and drop the new character */
+	if (QUEUED(rx) >= RXBUFFER_SIZE)
+		return;
 	/* Queue the character */
+	rx_buffer[rx.head & (RXBUFFER_SIZE - 1)] = ch;
 	rx.head++;
 	/* Check if an Xoff is in required */
 	if (rx.xon_enabled &&
 	    rx.xon_state &&
-	    (FREE(rx.head, rx.tail, BUFFER_SIZE) <= (BUFFER_SPARE))) {
+	    (QUEUED(rx) >= RXBUFFER_XOFF)) {
 		while(!TXIF);	// TBD: Could potentially wait forever here
 		TXREG = XOFF;
 		rx.xon_state = 0;
 	}
-
-	// TBD: In case of overflow - don't dequeue last char, just dump new chars
-
-	/* Check for an overflow */
-	if (rx.head == rx.tail)
-		/* Dequeue the oldest character */
-		rx.tail++;
 #endif /* RXBUFFER */
 }
 
@@ -174,13 +191,19 @@ void serial_rx_isr(void)
 void serial_tx_isr(void)
 {
 #ifdef TXBUFFER
+	/* Nothing to send: don't take what isn't there */
+	if (!QUEUED(tx)) {
+		TXIE = 0;
+		return;
+	}
+
 	/* Copy the character from the TX queue into the TX register */
-	TXREG = tx.buffer[tx.tail];
+	TXREG = tx_buffer[tx.tail & (TXBUFFER_SIZE - 1)];
 	/* Dequeue the character */
 	tx.tail++;
 
 	/* Disable tx interrupt if queue is empty */
-	if (tx.head == tx.tail)
+	if (!QUEUED(tx))
 		TXIE = 0;
 #endif /* TXBUFFER */
 }
@@ -189,30 +212,44 @@ void serial_tx_isr(void)
 /* Write a character to the serial port */
 void putch(char ch)
 {
+#ifdef HAS_FRAMING
+	/* In between frames, text goes out in frames of its own */
+	if (frame_active()) {
+		frame_text(ch);
+		return;
+	}
+#endif /* HAS_FRAMING */
+	serial_put(ch);
+}
+
+
+/* Write a character to the serial port, also while framing */
+void serial_put(char ch)
+{
 #ifdef TXBUFFER
-	unsigned char	queued = 0;
+	if (!SPEN)
+		return;
 
-	do {
-#ifdef RXBUFFER
-		RCIE = 0;	/* Disable rx interrupt for concurrency */
-#endif /* RXBUFFER */
-		TXIE = 0;	/* Disable tx interrupt for concurrency */
-
-		/* Check if there's room in the queue ((tx.head + 1) != tx.tail won't work due to bitfields being cast) */
-		if (FREE(tx.head, tx.tail, BUFFER_SIZE)) {
-			/* Copy the character into the TX queue */
-			tx.buffer[tx.head] = ch;
-			/* Queue the character */
-			tx.head++;
-			queued = 1;
-		} else
-			CLRWDT();
-		if (!tx.xon_enabled || tx.xon_state)
-			TXIE = 1;	/* Re-enable tx interrupt */
-#ifdef RXBUFFER
-		RCIE = 1;	/* Re-enable rx interrupt */
-#endif /* RXBUFFER */
-	} while (!queued);
+	/* Stopped by Xoff, the queue may not empty for as long as the host
+	   likes, so drop what doesn't fit rather than stall the main loop */
+	if ((QUEUED(tx) >= TXBUFFER_SIZE) && tx.xon_enabled && !tx.xon_state) {
+		if (tx_dropped < 0xFFFF)
+			tx_dropped++;
+		return;
+	}
+
+	/* Wait for room in the queue, a character time at most. Only the tx
+	   interrupt takes characters out, so send one by hand while
+	   interrupts are still disabled */
+	while (QUEUED(tx) >= TXBUFFER_SIZE)
+		if (TXIF && !GIE)
+			serial_tx_isr();
+
+	/* The tx interrupt only moves the tail */
+	tx_buffer[tx.head & (TXBUFFER_SIZE - 1)] = ch;
+	tx.head++;
+	if (!tx.xon_enabled || tx.xon_state)
+		TXIE = 1;	/* (Re-)enable tx interrupt */
 #else
 	if (!SPEN)
 		return;
@@ -259,15 +296,15 @@ unsigned char readch(char *ch)
 #endif /* TXBUFFER */
 
 	/* Check if there's anything to read */
-	if (rx.head != rx.tail) {
+	if (QUEUED(rx)) {
 		/* Copy the character from the RX queue */
-		*ch = rx.buffer[rx.tail];
+		*ch = rx_buffer[rx.tail & (RXBUFFER_SIZE - 1)];
 		/* Dequeue the character */
 		rx.tail++;
-		/* Check if an Xon is in required */
+		/* Check if an Xon is in required, well before running dry */
 		if (rx.xon_enabled &&
 		    !rx.xon_state &&
-		    (rx.head == rx.tail)) {
+		    (QUEUED(rx) <= RXBUFFER_XON)) {
 			while(!TXIF);
 			TXREG = XON;
 			rx.xon_state = 1;
@@ -277,7 +314,7 @@ unsigned char readch(char *ch)
 
 	RCIE = 1;	/* Re-enable rx interrupt */
 #ifdef TXBUFFER
-	if ((tx.head != tx.tail) && (!tx.xon_enabled || tx.xon_state))
+	if (QUEUED(tx) && (!tx.xon_enabled || tx.xon_state))
 		TXIE = 1;	/* Re-enable tx interrupt */
 #endif /* TXBUFFER */
 
@@ -346,4 +383,81 @@ unsigned char serial_wait_s(const char *s, unsigned long timeout)
 	}
 
 	return i;
-}
\ No newline at end of file
+}
+
+
+/* Check if nothing is being received or transmitted */
+unsigned char serial_idle(void)
+{
+#ifdef RXBUFFER
+	if (QUEUED(rx))
+		return 0;
+#endif /* RXBUFFER */
+#ifdef TXBUFFER
+	if (QUEUED(tx))
+		return 0;
+#endif /* TXBUFFER */
+
+	/* The last character must have left the shift register */
+	return (TRMT && !RCIF);
+}
+
+
+/* Number of characters dropped while the host held back the output */
+unsigned short serial_txdropped(void)
+{
+#ifdef TXBUFFER
+	return tx_dropped;
+#else
+	/* Every character waits for the previous one anyway */
+	return 0;
+#endif /* TXBUFFER */
+}
+
+
+/* Number of characters putch() can take without waiting */
+unsigned char serial_txfree(void)
+{
+#ifdef TXBUFFER
+	return TXBUFFER_SIZE - QUEUED(tx);
+#else
+	/* Every character waits for the previous one anyway */
+	return 0xFF;
+#endif /* TXBUFFER */
+}
+
+
+#ifdef _16F1939
+/* Prepare for sleep: the receiver doesn't run, so wake up on a start bit */
+void serial_sleep(void)
+{
+	WUE = 1;
+}
+
+
+/* Recover from sleep */
+void serial_wake(void)
+{
+	volatile unsigned char	dummy;
+
+	/* A wake-up by the receiver leaves a bogus character, which is lost */
+	if (RCIF) {
+		dummy = RCREG;
+		heard = 1;
+	}
+	WUE = 0;
+}
+
+
+/* Tells if anything was received since the last call, wake-ups included */
+unsigned char serial_heard(void)
+{
+	unsigned char	result;
+
+	RCIE = 0;	/* Disable rx interrupt for concurrency */
+	result = heard;
+	heard = 0;
+	RCIE = 1;
+	return result;
+}
+#endif /* _16F1939 */
@@ -72,10 +72,19 @@ void		serial_init	(unsigned long	bitrate,
 void		serial_term	(void);
 void		serial_rx_isr	(void);
 void		serial_tx_isr	(void);
-void		putch		(unsigned char	c);
+void		putch		(char		c);
+void		serial_put	(char		c);
 unsigned char	readch		(char		*ch);
 unsigned char	serial_wait_s	(const char	*s,
 				 unsigned long	timeout);
+unsigned char	serial_idle	(void);
+unsigned char	serial_txfree	(void);
+unsigned short	serial_txdropped(void);
+#ifdef _16F1939
+void		serial_sleep	(void);
+void		serial_wake	(void);
+unsigned char	serial_heard	(void);
+#endif /* _16F1939 */
 
 #endif /* HAS_SERIAL */
 
@@ -5,7 +5,13 @@
 /*		Copyright (C) 2010, Clockwork Engineering		      */
 /* History :	7 Mar 2010 by R. Delien:				      */
 /*		- Initial revision.					      */
+/*		16 Oct 2026:						      */
+/*		- Turned into a non-blocking block reader.		      */
 /******************************************************************************/
+#include "../common/app_prefs.h"
+
+#ifdef HAS_SRIX4K
+
 #include <htc.h>
 #include <stdio.h>
 
@@ -20,28 +26,44 @@
 /* Macros								      */
 /******************************************************************************/
 
-#define IDLE		0
-#define CARRIEROFF	1
-#define CARRIERON	7
-#define READUID
-#define READBLOCK	12
-#define WRITEBLOCK	22
+#define STATE_OFF		0	/* Carrier off, no tag selected */
+#define STATE_GET_CHIPID	1	/* Waiting for the tag to answer Initiate */
+#define STATE_GET_SELECT	2	/* Waiting for the tag to answer Select */
+#define STATE_SELECTED		3	/* Tag selected, waiting for a request */
+#define STATE_GET_BLOCK		4	/* Waiting for the tag to answer Read Block */
+
+#define CMD_INITIATE		0x06
+#define CMD_SELECT		0x0E
+#define CMD_READBLOCK		0x08
+
+#define CARRIER_ON		0x10
+#define CARRIER_OFF		0x00
+
+#define MAX_RETRIES		50	/* Polls for a single answer */
+#define MAX_ATTEMPTS		3	/* Sessions tried for a single read */
+#define RELEASE_TIME		(SECOND)	/* Carrier off after this idle time */
 
 
 /******************************************************************************/
 /* Global Data								      */
 /******************************************************************************/
 
-static struct timer	timer	= EXPIRED;
-static unsigned char	state	= 0;
-static unsigned long	cid[2]	= {0, 0};
+static struct timer	timer_release	= NEVER;
+static unsigned char	state		= STATE_OFF;
+static unsigned char	status		= SRIX4K_IDLE;
+static unsigned char	chip_id;
+static unsigned char	retries;
+static unsigned char	attempts;
+static unsigned char	block_nr;
+static unsigned char	block[SRIX4K_BLOCKSIZE];
 
-//static unsigned char	block	= 0;
 
 /******************************************************************************/
 /* Local Prototypes							      */
 /******************************************************************************/
 
+static void		fail			(void);
+
 
 /******************************************************************************/
 /* Global Implementations						      */
@@ -55,6 +77,8 @@ void srix4k_init (void)
 /*		- Initial revision.					      */
 /******************************************************************************/
 {
+	/* Queue the timers */
+	timer_register(&timer_release, TIMER_OWNER_SRIX4K);
 }
 /* End: srix4k_init */
 
@@ -62,141 +86,182 @@ void srix4k_init (void)
 void srix4k_work (void)
 /******************************************************************************/
 /* Function:	Module worker routine					      */
-/*		-       */
+/*		- Runs one I2C transaction with the reader per call, so a     */
+/*		  block read never stalls the main loop			      */
 /* History :	5 Mar 2010 by R. Delien:				      */
 /*		- Initial revision.					      */
+/*		16 Oct 2026:						      */
+/*		- Reads the requested block, keeping the tag selected.	      */
 /******************************************************************************/
 {
-	unsigned char	error = 0;
-	unsigned char	frame[4];
+	unsigned char	frame[2];
 	unsigned char	length;
 
 	switch (state) {
-	case IDLE:
-		if (timeoutexpired(&timer))
-			state++;
-		break;
-	case 1:
-		/* Turn on the carrier */
-		if (cr14_writeparamreg(0x10)) {
-			error = 1;
-			goto out;
-		}
-		state++;
-		break;
-	case 2:
-		/* Send an Init frame */
-		frame[0] = 0x06;
+	case STATE_OFF:
+		if (status != SRIX4K_BUSY)
+			break;
+		/* Turn on the carrier and send an Initiate frame */
+		frame[0] = CMD_INITIATE;
 		frame[1] = 0x00;
-		if (cr14_writeframe(frame, 2)) {
-			error = 2;
-			goto off;
+		if (cr14_writeparamreg(CARRIER_ON) ||
+		    cr14_writeframe(frame, 2)) {
+			fail();
+			break;
 		}
-		state++;
+		retries = 0;
+		state = STATE_GET_CHIPID;
 		break;
-	case 3:
-		/* Read the assigned node ID */
-		length = sizeof(frame);
-		if (cr14_readframe(frame, &length)) {
-			error = 3;
-			goto off;
+
+	case STATE_GET_CHIPID:
+		/* Read the assigned chip ID */
+		length = 1;
+		if (cr14_readframe(&chip_id, &length)) {
+			if (++retries >= MAX_RETRIES)
+				fail();
+			break;
 		}
 		if (length != 1) {
-			DBG("length = %d\n", length);
-			error = 4;
-			goto off;
+			/* No tag */
+			fail();
+			break;
 		}
-		state++;
-		break;
-	case 4:
-		/* Select the node */
-		frame[1] = frame[0];
-		frame[0] = 0x0E;
+		/* Select it */
+		frame[0] = CMD_SELECT;
+		frame[1] = chip_id;
 		if (cr14_writeframe(frame, 2)) {
-			error = 5;
-			goto off;
+			fail();
+			break;
 		}
-		state++;
+		retries = 0;
+		state = STATE_GET_SELECT;
 		break;
-	case 5:
+
+	case STATE_GET_SELECT:
 		/* Read the response */
-		length = sizeof(frame);
+		length = 1;
 		if (cr14_readframe(frame, &length)) {
-			error = 6;
-			goto off;
+			if (++retries >= MAX_RETRIES)
+				fail();
+			break;
 		}
-		if (length != 0) {
-			DBG("length = %d\n", length);
-			error = 7;
-			goto off;
+		if ((length != 1) || (frame[0] != chip_id)) {
+			/* Tag interference */
+			fail();
+			break;
 		}
-		state++;
-		break;
-	case 6:
-		/* Request the unique ID */
-		frame[0] = 0x0B;	/* Command 0x0B */
-		if (cr14_writeframe(frame, 1)) {
-			error = 8;
-			goto off;
-		}
-		state++;
-		break;
-	case 7:
-		/* Read the requested ID */
-		length = sizeof(cid);
-		if (cr14_readframe((unsigned char *)cid, &length)) {
-			error = 9;
-			goto off;
-		}
-		if (length != 8) {
-			DBG("length = %d\n", length);
-			error = 10;
-			goto off;
+		settimeout(&timer_release, RELEASE_TIME);
+		state = STATE_SELECTED;
+		/* no break; */
+
+	case STATE_SELECTED:
+		if (status != SRIX4K_BUSY) {
+			if (timer_due(TIMER_OWNER_SRIX4K) &&
+			    timeoutexpired(&timer_release)) {
+				/* Idle for a while, release the tag */
+				timeoutnever(&timer_release);
+				cr14_writeparamreg(CARRIER_OFF);
+				state = STATE_OFF;
+			}
+			break;
 		}
-//		DBG("ID: 0x%.8lX%.8lX\n", cid[1], cid[0]);
-		state++;
-	case 8:
-		/* Get the key */
-		frame[0] = 0x08;	/* Command 0x08 */
-		frame[1] = 0x0F;	/* Block nr. */
+		/* Request the block */
+		frame[0] = CMD_READBLOCK;
+		frame[1] = block_nr;
 		if (cr14_writeframe(frame, 2)) {
-			error = 11;
-			goto off;
+			fail();
+			break;
 		}
-		state++;
+		retries = 0;
+		state = STATE_GET_BLOCK;
 		break;
-	case 9:
-		/* Read the response */
-		length = sizeof(frame);
-		if (cr14_readframe(frame, &length)) {
-			error = 12;
-			goto off;
+
+	case STATE_GET_BLOCK:
+		/* Read the block */
+		length = sizeof(block);
+		if (cr14_readframe(block, &length)) {
+			if (++retries >= MAX_RETRIES)
+				fail();
+			break;
 		}
-		if (length != 4) {
-			DBG("length = %d\n", length);
-			error = 13;
-			goto off;
+		if (length != sizeof(block)) {
+			fail();
+			break;
 		}
-//		DBG("Key: 0x%.8lX\n", (unsigned long *)frame);
-		goto off;
+		status = SRIX4K_OK;
+		settimeout(&timer_release, RELEASE_TIME);
+		state = STATE_SELECTED;
+		break;
 	}
-
-	return;
-
-off:
-	/* Turn off the carrier */
-	cr14_writeparamreg(0x00);
-out:
-	/* Reset state machine */
-	state = IDLE;
-	/* Schedule next time */
-	settimeout(&timer, 3*SECOND);
-	if (error)
-		DBG("Err %d\n", error);
-	return;
 } /* srix4k_work */
 
 
+unsigned char srix4k_read (unsigned char nr)
+/******************************************************************************/
+/* Function:	srix4k_read						      */
+/*		- Request a block to be read. Returns 0 if a previous request */
+/*		  is still in progress, or its block wasn't collected yet     */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	if ((status != SRIX4K_IDLE) && (status != SRIX4K_ERROR))
+		return 0;
+
+	block_nr = nr;
+	attempts = 0;
+	status = SRIX4K_BUSY;
+	return 1;
+}
+/* End: srix4k_read */
+
+
+unsigned char srix4k_status (void)
+/******************************************************************************/
+/* Function:	srix4k_status						      */
+/*		- Returns the status of the last request		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	return status;
+}
+/* End: srix4k_status */
+
+
+unsigned char srix4k_data (unsigned char *data)
+/******************************************************************************/
+/* Function:	srix4k_data						      */
+/*		- Copies the block read and returns its number. Makes the     */
+/*		  reader available for the next request			      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	index;
+
+	for (index = 0; index < sizeof(block); index++)
+		data[index] = block[index];
+	status = SRIX4K_IDLE;
+	return block_nr;
+}
+/* End: srix4k_data */
+
+
 /******************************************************************************/
 /* Local Implementations						      */
-/******************************************************************************/
\ No newline at end of file
+/******************************************************************************/
+
+static void fail (void)
+{
+	/* Turn off the carrier and start all over */
+	cr14_writeparamreg(CARRIER_OFF);
+	timeoutnever(&timer_release);
+	state = STATE_OFF;
+	if (++attempts >= MAX_ATTEMPTS) {
+		DBG("Tag read error\n");
+		status = SRIX4K_ERROR;
+	}
+}
+
+#endif /* HAS_SRIX4K */
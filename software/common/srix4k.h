@@ -5,11 +5,26 @@
 /*		Copyright (C) 2010, Clockwork Engineering		      */
 /******************************************************************************/
 
-#ifndef SRIX4K_H				/* Include file already compiled? */
+#include "../common/app_prefs.h"
+
+#if !(defined SRIX4K_H) && (defined HAS_SRIX4K)		/* Include file already compiled? */
 #define SRIX4K_H
 
+#define SRIX4K_BLOCKSIZE	4	/* Number of bytes in a block */
+
+#define SRIX4K_IDLE		0	/* No read requested */
+#define SRIX4K_BUSY		1	/* Read in progress */
+#define SRIX4K_OK		2	/* Read finished, data available */
+#define SRIX4K_ERROR		3	/* Read failed */
+
+
 /* Generic */
 void		srix4k_init		(void) ;
 void		srix4k_work		(void) ;
 
+/* Control */
+unsigned char	srix4k_read		(unsigned char	block) ;
+unsigned char	srix4k_status		(void) ;
+unsigned char	srix4k_data		(unsigned char	*data) ;
+
 #endif /* SRIX4K_H */
@@ -8,6 +8,8 @@
 /******************************************************************************/
 #include <htc.h>
 
+#include "hardware.h"			/* Flexible hardware configuration */
+
 #include "timer.h"
 
 
@@ -15,10 +17,10 @@
 /* Macros								      */
 /******************************************************************************/
 
-struct longshort {
-	unsigned long	ls_longTicks ;	/* Least significant long */
-	unsigned short	ms_shortTicks ;	/* Most significant short */
-} ;
+#define TIMERQUEUE_SIZE		24	/* Maximum number of queued timers */
+
+#define WDTPS_MAX		18	/* Watchdog prescaler 1:32 << 18 = 256s */
+#define WDT_PERIOD(wdtps)	((unsigned long)MILISECOND << (wdtps))	/* Nominal watchdog period */
 
 
 /******************************************************************************/
@@ -26,12 +28,36 @@ struct longshort {
 /******************************************************************************/
 
 static volatile unsigned long	overflows	= 0;
+static struct timer		now		= EXPIRED;
+
+#ifdef HAS_TIMERQUEUE
+/* Registered timers, sorted by deadline, earliest first */
+static struct {
+	struct timer	*timer_p;
+	unsigned char	owner;
+}				queue[TIMERQUEUE_SIZE];
+static unsigned char		queued		= 0;
+static unsigned char		unqueued	= 0;	/* Owners that didn't fit in */
+static unsigned char		due		= TIMER_OWNER_ALL;
+static bit			rescheduled	= 0;	/* Expired timer set during this pass */
+#endif /* HAS_TIMERQUEUE */
 
 
 /******************************************************************************/
 /* Local Prototypes							      */
 /******************************************************************************/
 
+static void addticks (struct timer * const timer_p, unsigned long const ticks);
+#ifdef HAS_SLEEP
+static void addtimer1 (unsigned long const ticks);
+#endif /* HAS_SLEEP */
+#ifdef HAS_TIMERQUEUE
+static unsigned char earlier (struct timer const * const timer1_p, struct timer const * const timer2_p);
+static void requeue (struct timer const * const timer_p);
+#else
+#define requeue(timer_p)
+#endif /* HAS_TIMERQUEUE */
+
 
 /******************************************************************************/
 /* Global Implementations						      */
@@ -67,10 +93,159 @@ void timer_init (void)
 	TMR1ON = 1;
 	/* Enable timer 1 interrupt */
 	TMR1IE = 1;
+
+	/* Take the first snapshot for timeouts set during initialisation */
+	gettimestamp(&now);
 }
 /* End: timer_init */
 
 
+void timer_work (void)
+/******************************************************************************/
+/* Function:	Module worker routine					      */
+/*		- Takes the snapshot of the current time all timeouts are     */
+/*		  set from and checked against during this pass of the main   */
+/*		  loop							      */
+/*		- Marks the owners of all expired timers as due		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+#ifdef HAS_TIMERQUEUE
+	unsigned char	i;
+#endif /* HAS_TIMERQUEUE */
+
+	gettimestamp(&now);
+
+#ifdef HAS_TIMERQUEUE
+	/* The queue is sorted, so the first pending timer ends the search */
+	due = unqueued;
+	rescheduled = 0;
+	for (i = 0; i < queued; i++) {
+		if (earlier(&now, queue[i].timer_p))
+			break;
+		due |= queue[i].owner;
+	}
+#endif /* HAS_TIMERQUEUE */
+}
+/* End: timer_work */
+
+
+#ifdef HAS_TIMERQUEUE
+void timer_register (struct timer	* const timer_p,
+		     unsigned char	  const owner)
+/******************************************************************************/
+/* Function:	timer_register						      */
+/*		- Add a timer to the deadline queue			      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	/* An owner that doesn't fit in the queue just remains due all the time */
+	if (queued >= TIMERQUEUE_SIZE) {
+		unqueued |= owner;
+		due |= owner;
+		return;
+	}
+
+	/* Append the timer and move it to its place */
+	queue[queued].timer_p = timer_p;
+	queue[queued].owner = owner;
+	queued++;
+	requeue(timer_p);
+}
+/* End: timer_register */
+
+
+unsigned char timer_due (unsigned char const owner)
+/******************************************************************************/
+/* Function:	timer_due						      */
+/*		- Check if any of the timers of the given owner has expired   */
+/*		  This may return true for timers that changed since the      */
+/*		  last call to timer_work(), so use timeoutexpired() to find  */
+/*		  out which one					      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	return (due & owner);
+}
+/* End: timer_due */
+
+
+unsigned long timer_idle (void)
+/******************************************************************************/
+/* Function:	timer_idle						      */
+/*		- Returns the number of ticks until the first deadline that   */
+/*		  hasn't passed yet. Timers that were already expired at the  */
+/*		  start of this pass have been seen by their owners, so they  */
+/*		  don't keep the processor awake			      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	i;
+
+	/* Owners that don't fit in the queue or reset an expired timer need
+	 * another pass right away */
+	if (unqueued || rescheduled)
+		return (0);
+
+	for (i = 0; i < queued; i++)
+		if (earlier(&now, queue[i].timer_p))
+			return (timestampdiff(queue[i].timer_p, &now));
+
+	return (0xFFFFFFFF);
+}
+/* End: timer_idle */
+#endif /* HAS_TIMERQUEUE */
+
+
+#ifdef HAS_SLEEP
+void timer_sleep (unsigned long const ticks)
+/******************************************************************************/
+/* Function:	timer_sleep						      */
+/*		- Sleeps for at most the given number of ticks, using the     */
+/*		  watchdog as wake-up source. Timer 1 runs on the instruction */
+/*		  clock and stops during sleep, so the nominal watchdog       */
+/*		  period is added to it after a watchdog wake-up. A wake-up   */
+/*		  by an interrupt loses the time slept, which is never more   */
+/*		  than one watchdog period. The watchdog runs on the	      */
+/*		  LFINTOSC, which is off by tens of percents, so the time     */
+/*		  slept is only roughly right: don't sleep while it matters.  */
+/*		  Must be called with interrupts disabled.		      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+{
+	unsigned char	wdtcon;
+	unsigned char	wdtps	= 0;
+
+	/* Too short to be worth it */
+	if (ticks < WDT_PERIOD(0))
+		return;
+
+	/* Select the longest watchdog period that expires before the deadline */
+	while ((wdtps < WDTPS_MAX) && (WDT_PERIOD(wdtps + 1) <= ticks))
+		wdtps++;
+
+	wdtcon = WDTCON;
+	WDTCON = (wdtps << 1) | (wdtcon & 0x01);
+	CLRWDT();
+	SLEEP();
+	NOP();
+
+	/* A cleared time-out bit indicates the watchdog woke us up */
+	if (!nTO)
+		addtimer1(WDT_PERIOD(wdtps));
+
+	WDTCON = wdtcon;
+	CLRWDT();
+}
+/* End: timer_sleep */
+#endif /* HAS_SLEEP */
+
+
 void settimeout (struct timer	* const timer_p,
 		 unsigned long	  const timout)
 /******************************************************************************/
@@ -80,25 +255,13 @@ void settimeout (struct timer	* const timer_p,
 /*		- Ported from other project.				      */
 /******************************************************************************/
 {
-	unsigned long		tempLongTicks;		/* Overflow detection buffer */
-	struct longshort	*longshort = (struct longshort*)timer_p;
-
-	/* Fetch the current time */
-	gettimestamp(timer_p);
-
-	/* If no timeout is required, we're done */
-	if (!timout)
-		return;
-
-	/* Store lower value-before-adding to detect an overflow */
-	tempLongTicks = longshort->ls_longTicks;
+	/* Start from the time of this main loop pass */
+	*timer_p = now;
 
 	/* Add the requested delay */
-	longshort->ls_longTicks += timout;
+	addticks(timer_p, timout);
 
-	/* Carry an overflow to the most significant part */
-	if (longshort->ls_longTicks <= tempLongTicks)
-		longshort->ms_shortTicks++;
+	requeue(timer_p);
 }
 /* End: settimeout */
 
@@ -112,22 +275,14 @@ void postponetimeout (struct timer	* const timer_p,
 /*		- Ported from other project.				      */
 /******************************************************************************/
 {
-	unsigned long		tempLongTicks;		/* Overflow detection buffer */
-	struct longshort	*longshort = (struct longshort*)timer_p;
-
 	/* If no postponement is required, we're done */
 	if (!postpone)
 		return;
 
-	/* Store lower value-before-adding to detect an overflow */
-	tempLongTicks = longshort->ls_longTicks;
-
 	/* Add the requested postponement */
-	longshort->ls_longTicks += postpone;
+	addticks(timer_p, postpone);
 
-  	/* Carry an overflow to the most significant part */
-	if (longshort->ls_longTicks <= tempLongTicks)
-		longshort->ms_shortTicks++;
+	requeue(timer_p);
 }
 /* End: postponetimeout */
 
@@ -142,6 +297,8 @@ void timeoutnow (struct timer * const timer_p)
 {
 	timer_p->timer1    = 0x0000;
 	timer_p->overflows = 0x00000000;
+
+	requeue(timer_p);
 }
 /* End: timeoutnow */
 
@@ -156,6 +313,8 @@ void timeoutnever (struct timer * const timer_p)
 {
 	timer_p->timer1    = 0xFFFF;
 	timer_p->overflows = 0xFFFFFFFF;
+
+	requeue(timer_p);
 }
 /* End: timeoutnever */
 
@@ -168,18 +327,14 @@ unsigned char timeoutexpired (struct timer const * const timer_p)
 /*		- Ported from other project.				      */
 /******************************************************************************/
 {
-	struct timer	currentTime;
-
-	/* Fetch the current time */
-	gettimestamp (&currentTime);
-
-	if (currentTime.overflows == timer_p->overflows) {
-		if (currentTime.timer1 >= timer_p->timer1)
+	/* Compare against the time of this main loop pass */
+	if (now.overflows == timer_p->overflows) {
+		if (now.timer1 >= timer_p->timer1)
 			return 1;
 		else
 			return 0;
 	} else {
-		if (currentTime.overflows > timer_p->overflows)
+		if (now.overflows > timer_p->overflows)
 			return 1;
 		else
 			return 0;
@@ -244,38 +399,21 @@ unsigned long timestampdiff (struct timer	const	* const early_p,
 /*		- First implementation.					      */
 /******************************************************************************/
 {
-	unsigned long		diff = 0;
-	struct longshort	*early_longshort = (struct longshort*)early_p;
-	struct longshort	*late_longshort  = (struct longshort*)late_p;
-
-	/* Check Most Significant Shorts to quickly detect a negative difference */
-	if (early_longshort->ms_shortTicks >= late_longshort->ms_shortTicks) {
-		switch (early_longshort->ms_shortTicks - late_longshort->ms_shortTicks) {
-		case 0: /* Most Significant Shorts are equal */
-			if (early_longshort->ls_longTicks > late_longshort->ls_longTicks) {
-				/* Positive difference: Just subtract the Least Significant Longs */
-				diff = early_longshort->ls_longTicks - late_longshort->ls_longTicks;
-			}
-			break;
+	unsigned long		overflows;
 
-		case 1: /* Most Significant Long is increased just by 1 */
-			if (early_longshort->ls_longTicks < late_longshort->ls_longTicks) {
-				/* The Least Significant Long has only wrapped around */
-				diff = (0xFFFFFFFF - (late_longshort->ls_longTicks - early_longshort->ls_longTicks)) + 1;
-			} else {
-				/* The difference is positive, but just larger than the maximum of 9.5 hours */
-				diff = 0xFFFFFFFF;
-			}
-			break;
+	/* A negative difference is returned as 0 */
+	if( (early_p->overflows < late_p->overflows) ||
+	    ((early_p->overflows == late_p->overflows) &&
+	     (early_p->timer1 <= late_p->timer1)) )
+		return (0);
 
-		default: /* Most Significant Long is increased by two of more */
-			/* The difference is positive, but way larger than the maximum of 9.5 hours */
-			diff = 0xFFFFFFFF;
-			break;
-		}
-	}
+	/* The difference is positive, but may be larger than the maximum of 9.5 hours */
+	overflows = early_p->overflows - late_p->overflows;
+	if( (overflows > 0x00010000) ||
+	    ((overflows == 0x00010000) && (early_p->timer1 >= late_p->timer1)) )
+		return (0xFFFFFFFF);
 
-	return (diff);
+	return ((overflows << 16) + early_p->timer1 - late_p->timer1);
 }
 /* End: timestampdiff */
 
@@ -387,3 +525,79 @@ void timer_isr (void)
 /* Local Implementations						      */
 /******************************************************************************/
 
+static void addticks (struct timer	* const timer_p,
+		      unsigned long	  const ticks)
+{
+	unsigned long		timer1;			/* Overflow detection buffer */
+
+	/* Add the least significant part of the ticks to timer 1 */
+	timer1 = (unsigned long)timer_p->timer1 + (ticks & 0xFFFF);
+	timer_p->timer1 = (unsigned short)timer1;
+
+	/* Add the most significant part, and carry an overflow of timer 1 */
+	timer_p->overflows += (ticks >> 16) + (timer1 >> 16);
+}
+
+
+#ifdef HAS_TIMERQUEUE
+static unsigned char earlier (struct timer	const	* const timer1_p,
+			      struct timer	const	* const timer2_p)
+{
+	if (timer1_p->overflows == timer2_p->overflows)
+		return (timer1_p->timer1 < timer2_p->timer1);
+
+	return (timer1_p->overflows < timer2_p->overflows);
+}
+
+
+static void requeue (struct timer const * const timer_p)
+{
+	unsigned char	i;
+	unsigned char	owner;
+
+	/* Find the timer, which is not necessarily queued */
+	for (i = 0; i < queued; i++)
+		if (queue[i].timer_p == timer_p)
+			break;
+	if (i >= queued)
+		return;
+	owner = queue[i].owner;
+
+	/* Move the timer towards the head while it expires earlier */
+	for (; (i > 0) && earlier(timer_p, queue[i-1].timer_p); i--)
+		queue[i] = queue[i-1];
+
+	/* Move the timer towards the tail while it expires later */
+	for (; (i < queued-1) && earlier(queue[i+1].timer_p, timer_p); i++)
+		queue[i] = queue[i+1];
+
+	queue[i].timer_p = (struct timer *)timer_p;
+	queue[i].owner = owner;
+
+	/* The new deadline may have passed already */
+	if (!earlier(&now, timer_p)) {
+		due |= owner;
+		rescheduled = 1;
+	}
+}
+#endif /* HAS_TIMERQUEUE */
+
+
+#ifdef HAS_SLEEP
+static void addtimer1 (unsigned long const ticks)
+{
+	unsigned long		timer1;
+
+	TMR1ON = 0;
+
+	/* Add the least significant part of the ticks to timer 1 */
+	timer1 = (((unsigned long)TMR1H << 8) | TMR1L) + (ticks & 0xFFFF);
+	TMR1H = (unsigned char)(timer1 >> 8);
+	TMR1L = (unsigned char)timer1;
+
+	/* Add the most significant part, and carry an overflow of timer 1 */
+	overflows += (ticks >> 16) + (timer1 >> 16);
+
+	TMR1ON = 1;
+}
+#endif /* HAS_SLEEP */
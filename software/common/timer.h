@@ -8,6 +8,8 @@
 #ifndef TIMER_H				/* Include file already compiled? */
 #define TIMER_H
 
+#include "../common/app_prefs.h"
+
 #define SECOND		(((_XTAL_FREQ)/4)/8)	/* Number of timer ticks per second */
 #define MINUTE		(60 * (SECOND))		/* Number of timer ticks per minute */
 #define HOUR		(60 * (MINUTE))		/* Number of timer ticks per hour */
@@ -21,8 +23,32 @@ struct timer {
 	unsigned long	overflows ;
 };
 
+/* Owners of timers in the deadline queue */
+#define TIMER_OWNER_CATGENIE	0x01
+#define TIMER_OWNER_CATSENSOR	0x02
+#define TIMER_OWNER_WATER	0x04
+#define TIMER_OWNER_RTC		0x08
+#define TIMER_OWNER_USERINTERFACE 0x10
+#define TIMER_OWNER_LITTERLANGUAGE 0x20
+#define TIMER_OWNER_SRIX4K	0x40
+#define TIMER_OWNER_ALL		0xFF
+
 /* Generic */
 void		timer_init		(void) ;
+void		timer_work		(void) ;
+
+#ifdef HAS_TIMERQUEUE
+/* Deadline queue */
+void		timer_register		(struct timer		* const timer_p,
+					 unsigned char		  const owner) ;
+
+unsigned char	timer_due		(unsigned char		  const owner) ;
+
+unsigned long	timer_idle		(void) ;
+#else
+#define		timer_register(timer_p, owner)
+#define		timer_due(owner)	(1)
+#endif /* HAS_TIMERQUEUE */
 
 /* Event notification */
 void		timer_isr		(void) ;
@@ -46,6 +72,10 @@ void		gettimestamp		(struct timer		* const ticks) ;
 unsigned long	timestampdiff		(struct timer	const	* const early_p,
 					 struct timer	const	* const late_p) ;
 
+#ifdef HAS_SLEEP
+void		timer_sleep		(unsigned long		  const ticks) ;
+#endif /* HAS_SLEEP */
+
 void		delay			(unsigned long		* const delay) ;
 
 void		microdelay		(unsigned short		  const delay_us) ;
@@ -112,6 +112,9 @@ void water_init (void)
 	ADCON1bits.ADNREF = 0;
 	ADCON1bits.ADPREF = 0;
 #endif /* WATERSENSOR_ANALOG */
+
+	/* Queue the timer */
+	timer_register(&sensortimer, TIMER_OWNER_WATER);
 }
 /* End: water_init */
 
@@ -133,7 +136,8 @@ void water_work (void)
 	default:
 		state = LED_ON;
 	case LED_ON:
-		if (!timeoutexpired(&sensortimer))
+		if (!timer_due(TIMER_OWNER_WATER) ||
+		    !timeoutexpired(&sensortimer))
 			break;
 		/* Switch on the IR LED */
 		WATERSENSOR_LED(LAT) |= WATERSENSOR_LED_MASK;
@@ -146,7 +150,8 @@ void water_work (void)
 #endif /* WATERSENSOR_ANALOG */
 		break;
 	case START_CONVERSION:
-		if (!timeoutexpired(&sensortimer))
+		if (!timer_due(TIMER_OWNER_WATER) ||
+		    !timeoutexpired(&sensortimer))
 			break;
 		/* Start A/D conversion */
 		ADCON0bits.GO = 1;
@@ -159,7 +164,8 @@ void water_work (void)
 		/* Read out the IR sensor analoguely (lower value == more light reflected == no water detected) */
 		cur_reflectionquality = ADRES;
 #else
-		if (!timeoutexpired(&sensortimer))
+		if (!timer_due(TIMER_OWNER_WATER) ||
+		    !timeoutexpired(&sensortimer))
 			break;
 		/* Read out the IR sensor digitally (lower value == more light reflected == no water detected) */
 		cur_reflectionquality = (WATERSENSORANALOG(PORT) & WATERSENSORANALOG_MASK)?DETECTION_THRESHOLD:0;
@@ -226,6 +232,13 @@ void water_work (void)
 /* End: water_work */
 
 
+unsigned char water_busy (void)
+{
+	/* A measurement in progress is not waiting for its timer */
+	return (state == PROCESS_RESULT);
+}
+
+
 unsigned char water_detected (void)
 {
 	return (detected);
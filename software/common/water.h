@@ -29,6 +29,7 @@
 /* Generic */
 void		water_init		(void) ;
 void		water_work		(void) ;
+unsigned char	water_busy		(void) ;
 
 /* Getters */
 unsigned char	water_detected		(void) ;
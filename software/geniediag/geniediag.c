@@ -64,23 +64,23 @@ static int start (int argc, char* argv[]);
 static int setup (int argc, char* argv[]);
 static int lock (int argc, char* argv[]);
 
-/* command line commands */
+/* command line commands, sorted by name for a binary search */
 const struct command	commands[] = {
-	{"echo", echo},
-	{"help", help},
-	{"bowl", bowl},
 	{"arm", arm},
+	{"bowl", bowl},
+	{"cat", cat},
 	{"dosage", dosage},
-	{"tap", tap},
 	{"drain", drain},
 	{"dryer", dryer},
-	{"cat", cat},
-	{"water", water},
+	{"echo", echo},
 	{"heat", heat},
-	{"start", start},
-	{"setup", setup},
+	{"help", help},
 	{"lock", lock},
+	{"setup", setup},
+	{"start", start},
 	{"tag", tag},
+	{"tap", tap},
+	{"water", water},
 	{"", NULL}
 };
 #endif /* HAS_COMMANDLINE */
@@ -166,6 +166,7 @@ void main (void)
 
 	/* Execute the run loop */
 	for(;;){
+		timer_work();
 		catsensor_work();
 		water_work();
 		catgenie_work();
@@ -237,7 +238,8 @@ static void interrupt isr (void)
 	/* (E)USART interrupts */
 	if (RCIF)
 		serial_rx_isr();
-	if (TXIF)
+	/* TXIF is set whenever TXREG is empty, also while there's nothing to send */
+	if (TXIE && TXIF)
 		serial_tx_isr();
 }
 
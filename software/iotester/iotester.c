@@ -45,12 +45,12 @@ extern bit		__powerdown;
 extern bit		__timeout;
 #endif /* __RESETBITS_ADDR */
 
-/* command line commands */
+/* command line commands, sorted by name for a binary search */
 const struct command	commands[] = {
 	{"?", help},
-	{"help", help},
 	{"echo", echo},
 	{"gpio", gpio},
+	{"help", help},
 	{"", NULL}
 };
 
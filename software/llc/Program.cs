@@ -1,5 +1,6 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.Globalization;
 using System.Text;
 using System.IO;
 using System.Text.RegularExpressions;
@@ -19,9 +20,48 @@ namespace llc
         struct instruction_t
         {
             public byte opcode;
-            public UInt16 operand;
+            public UInt32 operand;
         }
 
+        // Label reference that can only be resolved once the whole source is read
+        struct fixup_t
+        {
+            public int index;
+            public string label;
+            public int line_no;
+            public string line;
+        }
+
+        // Outcome of running a program on the model of the interpreter
+        struct run_t
+        {
+            public UInt64 ticks;            // Time spent waiting, in timer ticks
+            public int water_waits;         // Waits for the water sensor, their duration is unknown
+            public int water_fills;         // Bowl fills, each one up to the water sensor
+            public UInt64 dosage_ul;        // Detergent dispensed, in microliters
+            public UInt64 dryer_ticks;      // Time the dryer is on
+            public UInt64 arm_ticks;        // Time the arm motor runs
+        }
+
+        // Program records and timer of the target, see litterlanguage.h and timer.h
+        const int INS_SIZE = 4;
+        const UInt32 INS_OPERAND_MAX = 0xFFFFFF;
+        const UInt32 TICKS_PER_SECOND = 125000;
+        const UInt32 TICKS_PER_MILISECOND = TICKS_PER_SECOND / 1000;
+
+        // Time of a full arm stroke, see ARM_STROKE in catgenie120.h
+        const UInt32 ARM_STROKE = 13500 * TICKS_PER_MILISECOND;
+
+        // Stack sizes of the interpreter, see litterlanguage.c
+        const int LOOP_DEPTH = 2;
+        const int CALL_DEPTH = 4;
+
+        // Mnemonics, the opcode values come from litterlanguage.h
+        static readonly string[] mnemonics = {
+            "START", "BOWL", "ARM", "WATER", "PUMP", "DRYER", "AUTODOSE", "WAITTIME", "WAITWATER",
+            "WAITDOSAGE", "SKIPIFDRY", "SKIPIFWET", "CALL", "RETURN", "END", "LOOP", "REPEAT"
+        };
+
         static void ParseDefines(string source_path)
         {
             Regex re = new Regex("^\\s*#define\\s+([^\\s\\/]+)\\s+([0-9]+|0x[0-9A-Fa-f]+)\\b");
@@ -59,135 +99,313 @@ namespace llc
             tr.Dispose();
         }
 
-        static void C2LLP(string source_path, string dest_path)
+        static string RemoveComments(string all)
         {
-            TextReader tr = new StreamReader(source_path);
-            TextWriter tw = new StreamWriter(dest_path);
-            string line;
-            string opcode;
-            string operand;
-            string last_line = "";
-            string parsed_line = "";
-            int pos;
-            bool first_line = true;
-            bool in_ifdef = false;
+            StringBuilder sb = new StringBuilder();
+            int start, pos1, pos2;
 
-            // TBD: Handle ifdefs and whatnot
-            // TBD: Handle comments
-            while ((line = tr.ReadLine()) != null)
+            start = 0;
+            while (true)
             {
-                line = line.Replace('\t', ' ').Replace(" ", "");
-
-                // Skip over conditional lines
-                // TBD: Check defines.  For now we're just ignoring anything between #ifdef and #else or #endif
-                if (in_ifdef)
+                pos1 = all.IndexOf("/*", start);
+                if (pos1 == -1)
                 {
-                    in_ifdef = line.StartsWith("#else") || line.StartsWith("#endif");
-                    continue;                        
+                    sb.Append(all.Substring(start));
+                    break;
                 }
-                if (line.StartsWith("#ifdef"))
+
+                pos2 = all.IndexOf("*/", pos1 + 2);
+                if (pos2 == -1)
                 {
-                    in_ifdef = true;
-                    continue;
+                    Console.WriteLine("Error: Unterminated comment line");
+                    return null;
                 }
 
-                if (parsed_line.Length == 0)
-                {
-                    if (line.StartsWith("conststructinstruction"))
-                    {
-                        pos = line.IndexOf('[');
-                        if (first_line)
-                            first_line = false;
-                        else
-                        {
-                            if (last_line.Length > 0)
-                            {
-                                tw.WriteLine(last_line);
-                                last_line = "";
-                            }
+                sb.Append(all.Substring(start, pos1 - start));
+                // Keep the line breaks, so line numbers still match
+                sb.Append('\n', all.Substring(pos1, pos2 - pos1).Split('\n').Length - 1);
+                start = pos2 + 2;
+            }
 
-                            tw.WriteLine();
-                        }
-                        last_line = line.Substring(22, pos - 22) + ":";
-                        continue;
-                    }
+            return sb.ToString();
+        }
 
-                    if (!line.StartsWith("{INS_")) continue;
-                }
+        static bool EvaluateCondition(string expr, HashSet<string> defined)
+        {
+            Match match;
+
+            expr = expr.Trim();
+            if (expr == "0") return false;
+            if (expr == "1") return true;
+
+            match = Regex.Match(expr, "^(!?)\\s*defined\\s*\\(?\\s*([A-Za-z0-9_]+)\\s*\\)?$");
+            if (match.Success)
+                return defined.Contains(match.Groups[2].Value) != (match.Groups[1].Value == "!");
+
+            Console.WriteLine("Warning: Can't evaluate condition [" + expr + "], assumed false");
+            return false;
+        }
 
-                parsed_line += line;
-                pos = parsed_line.IndexOf('}');
-                if (pos == -1) continue;
-
-                parsed_line = parsed_line.Substring(5, pos-5);
-                string[] s = parsed_line.Split(',');
-                opcode = s[0];
-                operand = s[1];
-
-                if (operand.StartsWith(opcode + "_"))
-                    operand = operand.Substring(opcode.Length + 1);
-                else if ((opcode == "PUMP") || (opcode == "DRYER") || (opcode == "WATER"))
-                    operand = (operand == "1") ? "ON" : "OFF";
-                else if (opcode == "CALL")
-                    operand = (operand.Split(')'))[1];
-                else if (opcode == "WAITTIME")
+        // Strips comments and the code of conditions that don't hold, leaving line breaks in place
+        static string Preprocess(string source_path)
+        {
+            TextReader tr = new StreamReader(source_path);
+            string all = RemoveComments(tr.ReadToEnd().Replace("\r", ""));
+            tr.Dispose();
+            if (all == null) return null;
+
+            HashSet<string> defined = new HashSet<string>();
+            Stack<bool[]> conds = new Stack<bool[]>();      // {enclosing active, branch taken, active}
+            StringBuilder sb = new StringBuilder();
+            bool active = true;
+            int pos;
+
+            foreach (string l in all.Split('\n'))
+            {
+                string line = l;
+
+                if ((pos = line.IndexOf("//")) != -1) line = line.Substring(0, pos);
+                line = line.Trim();
+
+                if (!line.StartsWith("#"))
                 {
-                    opcode = "DELAY";
-                    operand = (double.Parse(operand) / 1000).ToString();
+                    if (active) sb.Append(line);
+                    sb.Append('\n');
+                    continue;
                 }
-                else if (opcode.StartsWith("WAIT"))
+                sb.Append('\n');
+
+                Match match = Regex.Match(line, "^#\\s*([a-z]+)\\s*(.*)$");
+                string directive = match.Groups[1].Value;
+                string arg = match.Groups[2].Value.Trim();
+                bool cond;
+
+                switch (directive)
                 {
-                    if (opcode == "WAITWATER")
+                case "define":
+                    if (active) defined.Add(arg.Split(' ', '\t', '(')[0]);
+                    break;
+                case "undef":
+                    if (active) defined.Remove(arg);
+                    break;
+                case "ifdef":
+                case "ifndef":
+                case "if":
+                    if (directive == "if")
+                        cond = active && EvaluateCondition(arg, defined);
+                    else
+                        cond = active && (defined.Contains(arg) == (directive == "ifdef"));
+                    conds.Push(new bool[] {active, cond, cond});
+                    active = cond;
+                    break;
+                case "elif":
+                case "else":
+                    if (conds.Count == 0)
                     {
-                        operand = (operand == "1") ? "WATER_HIGH" : "WATER_LOW";
+                        Console.WriteLine("Error: #" + directive + " without #if");
+                        return null;
                     }
-                    else
+                    bool[] c = conds.Peek();
+                    cond = c[0] && !c[1] && ((directive == "else") || EvaluateCondition(arg, defined));
+                    c[1] |= cond;
+                    c[2] = cond;
+                    active = cond;
+                    break;
+                case "endif":
+                    if (conds.Count == 0)
                     {
-                        operand = opcode.Substring(4);
-                        if (operand == "DOSAGE") operand = "DOSE";
+                        Console.WriteLine("Error: #endif without #if");
+                        return null;
                     }
-                    opcode = "WAIT";
+                    active = conds.Pop()[0];
+                    break;
                 }
-                else if (opcode == "START")
-                    operand = operand.Replace("|", ", ");
-                else if ((opcode == "RETURN") || (opcode == "END"))
-                    operand = "";
+            }
 
-                if (operand.Length == 0)
-                    parsed_line = opcode;
-                else
-                    parsed_line = opcode.PadRight(16) + operand;
+            if (conds.Count > 0)
+            {
+                Console.WriteLine("Error: Unterminated #if");
+                return null;
+            }
+
+            return sb.ToString();
+        }
+
+        // Splits the INS(opcode, operand) entries of a table, with all whitespace removed
+        static List<string[]> ParseTable(string body)
+        {
+            List<string[]> entries = new List<string[]>();
+            int pos = 0;
 
-                if (last_line.Contains(":") && (opcode == "START"))
+            body = Regex.Replace(body, "\\s", "");
+            while ((pos = body.IndexOf("INS(", pos)) != -1)
+            {
+                int depth = 0;
+                int end;
+
+                pos += 4;
+                for (end = pos; end < body.Length; end++)
                 {
-                    // Combine label + start
-                    if (operand.Contains("FLAGS_WETRUN") && operand.Contains("FLAGS_DRYRUN"))
-                        last_line = last_line.PadRight(16) + "WET, DRY";
-                    else if (operand.Contains("FLAGS_WETRUN"))
-                        last_line = last_line.PadRight(16) + "WET";
-                    else if (operand.Contains("FLAGS_DRYRUN"))
-                        last_line = last_line.PadRight(16) + "DRY";
+                    if (body[end] == '(') depth++;
+                    else if ((body[end] == ')') && (depth-- == 0)) break;
                 }
-                else if (last_line.StartsWith("DELAY ") && opcode.Equals("DELAY"))
+
+                string entry = body.Substring(pos, end - pos);
+                int comma = entry.IndexOf(',');
+                entries.Add(new string[] {entry.Substring(0, comma), entry.Substring(comma + 1)});
+                pos = end;
+            }
+
+            return entries;
+        }
+
+        static string FormatLabel(string label, string attributes)
+        {
+            if (attributes.Length == 0)
+                return label + ":";
+            return (label + ":").PadRight(16) + attributes;
+        }
+
+        static string FormatStatement(string opcode, string operand)
+        {
+            if (operand.Length == 0)
+                return opcode;
+            return opcode.PadRight(16) + operand;
+        }
+
+        static string FormatSeconds(decimal seconds)
+        {
+            return seconds.ToString("0.######", CultureInfo.InvariantCulture);
+        }
+
+        static bool C2LLP(string source_path, string dest_path)
+        {
+            Regex re_table = new Regex("constunsignedchar([A-Za-z0-9_]+)\\[\\]=\\{(.*?)\\};", RegexOptions.Singleline);
+            string all = Preprocess(source_path);
+            if (all == null) return false;
+
+            TextWriter tw = new StreamWriter(dest_path);
+            bool first_table = true;
+            int errors = 0;
+
+            foreach (Match table in re_table.Matches(Regex.Replace(all, "\\s", "")))
+            {
+                string name = table.Groups[1].Value;
+                List<string[]> entries = ParseTable(table.Groups[2].Value);
+                Dictionary<int, string> skip_labels = new Dictionary<int, string>();
+                string last_line = "";
+                string attributes = "";
+                int i;
+
+                // Skip counts refer to C entries, which don't map one-on-one onto LLP statements. Label their targets instead.
+                for (i = 0; i < entries.Count; i++)
                 {
-                    // Merge DELAYs together
-                    last_line = "DELAY".PadRight(16) + (double.Parse(last_line.Substring(6).TrimStart()) + double.Parse(operand)).ToString();
+                    if ((entries[i][0] != "SKIPIFDRY") && (entries[i][0] != "SKIPIFWET")) continue;
+
+                    int target = i + 1 + int.Parse(entries[i][1]);
+                    if (target >= entries.Count)
+                    {
+                        Console.WriteLine(name + "[" + i + "]: Error: INS_" + entries[i][0] + " skips past the end of the table");
+                        errors++;
+                        continue;
+                    }
+                    if (!skip_labels.ContainsKey(target))
+                        skip_labels.Add(target, name + "_skip" + (skip_labels.Count + 1));
                 }
+
+                if (first_table)
+                    first_table = false;
                 else
+                    tw.WriteLine();
+
+                // Combine label + start
+                if ((entries.Count > 0) && (entries[0][0] == "START"))
                 {
-                    if (last_line.Length > 0)
-                        tw.WriteLine(last_line);
-                    last_line = parsed_line;
+                    foreach (string flag in entries[0][1].Split('|'))
+                    {
+                        if (flag == "FLAGS_WETRUN") attributes += ", WET";
+                        else if (flag == "FLAGS_DRYRUN") attributes += ", DRY";
+                        else if (flag == "FLAGS_AUTORUN") attributes += ", AUTO";
+                    }
+                    if (attributes.Length > 0) attributes = attributes.Substring(2);
                 }
+                tw.WriteLine(FormatLabel(name, attributes));
 
-                parsed_line = "";
-            }
+                for (i = (attributes.Length > 0) ? 1 : 0; i < entries.Count; i++)
+                {
+                    string opcode = entries[i][0];
+                    string operand = entries[i][1];
+                    string label;
+
+                    if (opcode == "START")
+                    {
+                        Console.WriteLine(name + "[" + i + "]: Error: INS_START only allowed as first instruction");
+                        errors++;
+                        continue;
+                    }
 
-            if (last_line.Length > 0)
-                tw.WriteLine(last_line);
+                    if (skip_labels.TryGetValue(i, out label))
+                    {
+                        if (last_line.Length > 0)
+                            tw.WriteLine(last_line);
+                        last_line = "";
+                        tw.WriteLine(FormatLabel(label, ""));
+                    }
+
+                    if ((opcode == "BOWL") && operand.StartsWith("BOWL_"))
+                        operand = operand.Substring(5);
+                    else if ((opcode == "ARM") && operand.StartsWith("INS_ARM__"))
+                        operand = operand.Substring(9);
+                    else if ((opcode == "PUMP") || (opcode == "DRYER") || (opcode == "WATER"))
+                        operand = (operand == "1") ? "ON" : "OFF";
+                    else if ((opcode == "CALL") && operand.StartsWith("ROM_"))
+                        operand = operand.Substring(4).ToLower();
+                    else if ((opcode == "SKIPIFDRY") || (opcode == "SKIPIFWET"))
+                    {
+                        if (skip_labels.TryGetValue(i + 1 + int.Parse(operand), out label))
+                            operand = label;
+                    }
+                    else if (opcode == "WAITTIME")
+                    {
+                        // Waits are written as MS(milliseconds), or in timer ticks
+                        opcode = "DELAY";
+                        if (operand.StartsWith("MS(") && operand.EndsWith(")"))
+                            operand = FormatSeconds(decimal.Parse(operand.Substring(3, operand.Length - 4), CultureInfo.InvariantCulture) / 1000);
+                        else
+                            operand = FormatSeconds(decimal.Parse(operand, CultureInfo.InvariantCulture) / TICKS_PER_SECOND);
+                    }
+                    else if (opcode == "WAITWATER")
+                    {
+                        opcode = "WAIT";
+                        operand = (operand == "1") ? "WATER_HIGH" : "WATER_LOW";
+                    }
+                    else if (opcode == "WAITDOSAGE")
+                    {
+                        opcode = "WAIT";
+                        operand = "DOSE";
+                    }
+                    else if ((opcode == "RETURN") || (opcode == "END") || (opcode == "REPEAT"))
+                        operand = "";
+
+                    if (last_line.StartsWith("DELAY ") && opcode.Equals("DELAY"))
+                    {
+                        // Merge DELAYs together
+                        last_line = FormatStatement("DELAY", FormatSeconds(decimal.Parse(last_line.Substring(6).TrimStart(), CultureInfo.InvariantCulture) + decimal.Parse(operand, CultureInfo.InvariantCulture)));
+                    }
+                    else
+                    {
+                        if (last_line.Length > 0)
+                            tw.WriteLine(last_line);
+                        last_line = FormatStatement(opcode, operand);
+                    }
+                }
+
+                if (last_line.Length > 0)
+                    tw.WriteLine(last_line);
+            }
 
-            tr.Dispose();
             tw.Dispose();
+            return (errors == 0);
         }
 
         static bool ResolveOpcode(string key, out byte opcode)
@@ -204,7 +422,7 @@ namespace llc
             return true;
         }
 
-        static bool ResolveOperand(string key, out UInt16 operand)
+        static bool ResolveOperand(string key, out UInt32 operand)
         {
             def_t def;
 
@@ -218,92 +436,145 @@ namespace llc
             return true;
         }
 
-        static void WriteInstruction(FileStream fo, ref UInt16 pc, instruction_t inst)
+        static string Mnemonic(byte opcode)
         {
-            byte[] buf = {inst.opcode, (byte)((inst.operand & 0xFF00) >> 8), (byte)(inst.operand & 0xFF)};
-            fo.Write(buf, 0, 3);
-            pc += 3;
+            byte value;
+
+            foreach (string mnemonic in mnemonics)
+                if (ResolveOpcode("INS_" + mnemonic, out value) && (value == opcode))
+                    return mnemonic;
+            return null;
         }
 
-        static void LogError(string source_path, UInt16 line_no, string line, string error)
+        static void LogError(string source_path, int line_no, string line, string error)
         {
-            Console.WriteLine(Path.GetFileName(source_path) + "(" + line_no + 1 + "): Error: " + error);
+            Console.WriteLine(Path.GetFileName(source_path) + "(" + (line_no + 1) + "): Error: " + error);
             Console.WriteLine(line);
         }
 
-        static void LLP2BIN(string source_path, string dest_path)
+        // Names a program address after the closest label before it
+        static string Where(Dictionary<int, string> names, int pc)
         {
-            Regex re_label = new Regex("^([A-Za-z0-9_\\-]+):\\s*(?:([A-Za-z0-9_\\-]+)(?:\\s*,\\s*){0,1})*$");
-            Regex re_inst = new Regex("^([A-Za-z0-9_\\-]+)\\s*(?:([A-Za-z0-9_\\-\\.]+)(?:\\s*,\\s*){0,1})*$");
-            Dictionary<string, UInt16> labels = new Dictionary<string, UInt16>();
-            TextReader tr = new StreamReader(source_path);
-            FileStream fo = new FileStream(dest_path, FileMode.Create);
-            string all = tr.ReadToEnd();
-            StringBuilder sb = new StringBuilder();
-            int start, pos1, pos2;
-            tr.Dispose();            
-            
-            //--------
-            // Step 1: Remove /* ... */ comments
-            //--------
+            int at;
 
-            start = 0;
-            while (true)
+            for (at = pc; at >= 0; at--)
+                if (names.ContainsKey(at))
+                    return "(pc=" + pc + ", " + names[at] + ((at == pc) ? "" : ("+" + (pc - at))) + ")";
+            return "(pc=" + pc + ")";
+        }
+
+        static List<instruction_t> ReadImage(string path)
+        {
+            List<instruction_t> code = new List<instruction_t>();
+            FileStream fi = new FileStream(path, FileMode.Open);
+            byte[] buf = new byte[INS_SIZE];
+            instruction_t inst;
+
+            while (fi.Read(buf, 0, INS_SIZE) == INS_SIZE)
             {
-                pos1 = all.IndexOf("/*", start);
-                if (pos1 == -1)
-                {
-                    sb.Append(all.Substring(start));
-                    break;
-                }
-                
-                pos2 = all.IndexOf("*/", pos1 + 2);
-                if (pos2 == -1)
-                {
-                    Console.WriteLine("Error: Unterminated comment line");
-                    return;
-                }
+                inst.opcode = buf[0];
+                inst.operand = ((UInt32)buf[1] << 16) | ((UInt32)buf[2] << 8) | buf[3];
+                code.Add(inst);
+            }
 
-                sb.Append(all.Substring(start, pos1 - start));
-                start = pos2 + 2;
+            fi.Dispose();
+            return code;
+        }
+
+        static void WriteImage(string path, List<instruction_t> code)
+        {
+            FileStream fo = new FileStream(path, FileMode.Create);
+
+            foreach (instruction_t inst in code)
+            {
+                byte[] buf = {inst.opcode, (byte)((inst.operand >> 16) & 0xFF), (byte)((inst.operand >> 8) & 0xFF), (byte)(inst.operand & 0xFF)};
+                fo.Write(buf, 0, INS_SIZE);
+            }
+
+            fo.Dispose();
+        }
+
+        // Gives every program, sub-routine and skip target a label, keeping the ones already known
+        static Dictionary<int, string> NameLabels(List<instruction_t> code, Dictionary<int, string> known)
+        {
+            Dictionary<int, string> names = new Dictionary<int, string>(known);
+            int programs = 0, subs = 0, skips = 0;
+            int target;
+
+            byte INS_START;                 ResolveOpcode   ("INS_START",       out INS_START       );
+            byte INS_CALL;                  ResolveOpcode   ("INS_CALL",        out INS_CALL        );
+            byte INS_SKIPIFDRY;             ResolveOpcode   ("INS_SKIPIFDRY",   out INS_SKIPIFDRY   );
+            byte INS_SKIPIFWET;             ResolveOpcode   ("INS_SKIPIFWET",   out INS_SKIPIFWET   );
+
+            for (int pc = 0; pc < code.Count; pc++)
+            {
+                if ((code[pc].opcode == INS_START) && !names.ContainsKey(pc))
+                    names.Add(pc, "program" + (++programs));
+            }
+            for (int pc = 0; pc < code.Count; pc++)
+            {
+                target = (int)code[pc].operand;
+                if ((code[pc].opcode == INS_CALL) && (target < code.Count) && !names.ContainsKey(target))
+                    names.Add(target, "sub" + (++subs));
             }
-            all = sb.ToString();
+            for (int pc = 0; pc < code.Count; pc++)
+            {
+                target = pc + 1 + (int)code[pc].operand;
+                if (((code[pc].opcode == INS_SKIPIFDRY) || (code[pc].opcode == INS_SKIPIFWET)) && (target < code.Count) && !names.ContainsKey(target))
+                    names.Add(target, "skip" + (++skips));
+            }
+
+            return names;
+        }
+
+        static bool LLP2BIN(string source_path, string dest_path, Dictionary<int, string> names)
+        {
+            Regex re_label = new Regex("^([A-Za-z0-9_\\-]+):\\s*(?:([A-Za-z0-9_\\-]+)(?:\\s*,\\s*){0,1})*$");
+            Regex re_inst = new Regex("^([A-Za-z0-9_\\-]+)\\s*(?:([A-Za-z0-9_\\-\\.]+)(?:\\s*,\\s*){0,1})*$");
+            Dictionary<string, int> labels = new Dictionary<string, int>();
+            List<instruction_t> code = new List<instruction_t>();
+            List<fixup_t> fixups = new List<fixup_t>();
+            TextReader tr = new StreamReader(source_path);
+            string all = tr.ReadToEnd().Replace("\r", "");
+            int errors = 0;
+            int pos1;
+            tr.Dispose();
 
             //--------
-            // Step 2: Pre-scan for labels, uppercase everything, remove //-style comments
+            // Step 1: Remove /* ... */ comments
             //--------
-            
-            // TBD
+
+            if ((all = RemoveComments(all)) == null)
+                return false;
 
             //--------
-            // Step 3: Parse/translate instructions
+            // Step 2: Parse/translate instructions, leaving label references open
             //--------
 
-            UInt16 line_no;
+            int line_no;
             string line;
             string[] lines = all.Split('\n');
             Match match;
 
             byte INS_START;                 ResolveOpcode   ("INS_START",       out INS_START       );
-            byte INS_END;                   ResolveOpcode   ("INS_END",         out INS_END         );
+            byte INS_LAST;                  ResolveOpcode   ("INS_LAST",        out INS_LAST        );
             byte INS_WAITTIME;              ResolveOpcode   ("INS_WAITTIME",    out INS_WAITTIME    );
-            UInt16 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
-            UInt16 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
+            UInt32 FLAGS_AUTORUN;           ResolveOperand  ("FLAGS_AUTORUN",   out FLAGS_AUTORUN   );
+            UInt32 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
+            UInt32 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
+            UInt32 INS_ARM__MAX;            ResolveOperand  ("INS_ARM__MAX",    out INS_ARM__MAX    );
 
             instruction_t inst;
             string opcode;
             string operand;
-            UInt16 pc;
 
-            pc = 0;
             for (line_no = 0; line_no < lines.Length; line_no++)
             {
                 // Uppercase & Remove whitespace
-                // TBD: line_orig?
                 line = lines[line_no].ToUpper().Trim();
 
                 // Remove //-style comments
-                if ((pos1 = line.IndexOf("//")) != -1) line = line.Substring(pos1).Trim();  // TBD: Test
+                if ((pos1 = line.IndexOf("//")) != -1) line = line.Substring(0, pos1).Trim();
 
                 // Skip over empty lines
                 if (line.Length == 0) continue;
@@ -312,23 +583,24 @@ namespace llc
                 if ((match = re_label.Match(line)).Length > 0)
                 {
                     string label = match.Groups[1].Captures[0].Value;
-                    UInt16 label_pc;
+                    int label_pc;
 
                     if (labels.TryGetValue(label, out label_pc))
                     {
                         LogError(source_path, line_no, line, "Label already defined @ pc=" + label_pc.ToString());
-                        goto fail;
+                        errors++;
+                        continue;
                     }
 
-                    labels.Add(label, pc);
+                    labels.Add(label, code.Count);
                     CaptureCollection args = match.Groups[2].Captures;
-                    
-                    if (args.Count > 1)
+
+                    if (args.Count > 0)
                     {
                         // If there are args, we have to write an INS_START instruction
 
                         inst.opcode = INS_START;
-                        inst.operand = INS_END;
+                        inst.operand = INS_LAST;
 
                         for (int i = 0; i < args.Count; i++)
                         {
@@ -340,9 +612,18 @@ namespace llc
                             {
                                 inst.operand |= FLAGS_DRYRUN;
                             }
+                            else if (args[i].Value == "AUTO")
+                            {
+                                inst.operand |= FLAGS_AUTORUN;
+                            }
+                            else
+                            {
+                                LogError(source_path, line_no, line, "Unknown program attribute [" + args[i].Value + "]");
+                                errors++;
+                            }
                         }
 
-                        WriteInstruction(fo, ref pc, inst);
+                        code.Add(inst);
                     }
 
                     continue;
@@ -360,7 +641,8 @@ namespace llc
                         if (args.Count < 1)
                         {
                             LogError(source_path, line_no, line, "One or more operands required");
-                            break;
+                            errors++;
+                            continue;
                         }
 
                         char[] sep = {'_'};
@@ -375,64 +657,77 @@ namespace llc
                             if (!ResolveOpcode("INS_WAIT" + a[0], out inst.opcode))
                             {
                                 LogError(source_path, line_no, line, "Unknown operand [" + args[i].Value + "]");
-                                goto fail;
+                                errors++;
+                                continue;
                             }
 
                             if (!ResolveOperand(args[i].Value, out inst.operand))
                             {
                                 LogError(source_path, line_no, line, "Unknown operand value [" + args[i].Value + "]");
-                                goto fail;
+                                errors++;
+                                continue;
                             }
 
-                            WriteInstruction(fo, ref pc, inst);                            
+                            code.Add(inst);
                         }
 
                         continue;
                     }
 
-                    // DELAY: Convert to INS_WAITTIME, Convert from s to ms, break up into multiple 65535ms instructions
+                    // DELAY: Convert to INS_WAITTIME, Convert from s to timer ticks, break up into multiple instructions if it exceeds the operand
                     if (opcode == "DELAY")
                     {
+                        decimal delay;
+
                         inst.opcode = INS_WAITTIME;
                         if (args.Count != 1)
                         {
                             LogError(source_path, line_no, line, ((args.Count == 0) ? "Operand required" : "Too many operands"));
-                            break;
+                            errors++;
+                            continue;
+                        }
+                        if (!decimal.TryParse(args[0].Value, NumberStyles.AllowDecimalPoint, CultureInfo.InvariantCulture, out delay))
+                        {
+                            LogError(source_path, line_no, line, "Delay is not a number of seconds [" + args[0].Value + "]");
+                            errors++;
+                            continue;
                         }
 
-                        double delay = double.Parse(args[0].Value) * 1000;
-                        if (delay > 65535)
+                        delay = Math.Round(delay * TICKS_PER_SECOND);
+                        if (delay > INS_OPERAND_MAX)
                         {
-                            inst.operand = 65535;
+                            inst.operand = INS_OPERAND_MAX;
                             while (delay > inst.operand)
                             {
-                                WriteInstruction(fo, ref pc, inst);
+                                code.Add(inst);
                                 delay -= inst.operand;
                             }
                         }
-                        inst.operand = (UInt16)delay;
-                        WriteInstruction(fo, ref pc, inst);
+                        inst.operand = (UInt32)delay;
+                        code.Add(inst);
                         continue;
                     }
 
                     // Look up opcode #define
-                    if (!ResolveOpcode("INS_" + opcode, out inst.opcode))
+                    if ((Array.IndexOf(mnemonics, opcode) < 0) || !ResolveOpcode("INS_" + opcode, out inst.opcode))
                     {
                         LogError(source_path, line_no, line, "Unknown opcode");
-                        break;
+                        errors++;
+                        continue;
                     }
 
-                    // END/RETURN: No operand
-                    if ((opcode == "END") || (opcode == "RETURN"))
+                    // END/RETURN/REPEAT: No operand
+                    if ((opcode == "END") || (opcode == "RETURN") || (opcode == "REPEAT"))
                     {
                         if (args.Count > 0)
                         {
                             LogError(source_path, line_no, line, "Operand not allowed");
-                            break;
+                            errors++;
+                            continue;
                         }
 
                         inst.operand = 0;
-                        WriteInstruction(fo, ref pc, inst);
+                        code.Add(inst);
                         continue;
                     }
 
@@ -440,93 +735,600 @@ namespace llc
                     if (args.Count != 1)
                     {
                         LogError(source_path, line_no, line, ((args.Count == 0) ? "Operand required" : "Too many operands"));
-                        break;
+                        errors++;
+                        continue;
                     }
                     operand = args[0].Value;
 
-                    // Special case: CALL - We need to look up the label
-                    if (opcode == "CALL")
+                    // CALL/SKIPIFDRY/SKIPIFWET - Labels are resolved once all of them are known
+                    if ((opcode == "CALL") || (((opcode == "SKIPIFDRY") || (opcode == "SKIPIFWET")) && !Char.IsDigit(operand[0])))
                     {
-                        UInt16 jump_pc;
+                        fixup_t fixup;
 
-                        if (!labels.TryGetValue(operand, out jump_pc))
+                        fixup.index = code.Count;
+                        fixup.label = operand;
+                        fixup.line_no = line_no;
+                        fixup.line = line;
+                        fixups.Add(fixup);
+
+                        inst.operand = 0;
+                        code.Add(inst);
+                        continue;
+                    }
+
+                    // LOOP/AUTODOSE/SKIPIFDRY/SKIPIFWET - Numeric values
+                    if ((opcode == "LOOP") || (opcode == "AUTODOSE") || (opcode == "SKIPIFDRY") || (opcode == "SKIPIFWET"))
+                    {
+                        if (!UInt32.TryParse(operand, out inst.operand) || (inst.operand > INS_OPERAND_MAX))
                         {
-                            LogError(source_path, line_no, line, "Label not found [" + operand + "]");
-                            break;
+                            LogError(source_path, line_no, line, "Operand out of range [" + operand + "]");
+                            errors++;
+                            continue;
                         }
-
-                        inst.operand = jump_pc;
-                        WriteInstruction(fo, ref pc, inst);
+                        code.Add(inst);
                         continue;
                     }
 
-                    // AUTODOSE/SKIPIFDRY - Always a numeric value
-                    if ((opcode == "AUTODOSE") || (opcode == "SKIPIFDRY"))
+                    // ARM - Named position, or a position in percent of the stroke
+                    if (opcode == "ARM")
                     {
-                        inst.operand = UInt16.Parse(operand);
-                        WriteInstruction(fo, ref pc, inst);
+                        if (ResolveOperand("INS_ARM__" + operand, out inst.operand) ||
+                            (UInt32.TryParse(operand, out inst.operand) && (inst.operand <= INS_ARM__MAX)))
+                        {
+                            code.Add(inst);
+                            continue;
+                        }
+                        LogError(source_path, line_no, line, "Unknown arm position [" + operand + "]");
+                        errors++;
                         continue;
                     }
 
                     // Everything else uses defines
                     if (ResolveOperand(opcode + "_" + operand, out inst.operand))
                     {
-                        WriteInstruction(fo, ref pc, inst);
+                        code.Add(inst);
                         continue;
                     }
                     LogError(source_path, line_no, line, "Unknown operand value [" + operand + "] for opcode [" + opcode + "]");
-
-                    break;
+                    errors++;
+                    continue;
                 }
 
                 // Don't know what this line is
                 LogError(source_path, line_no, line, "Malformed line");
-                break;
+                errors++;
             }
 
-            Console.WriteLine("Compiled " + lines.Length + " lines into " + (pc/3) + " instructions (" + pc + " bytes)");
+            //--------
+            // Step 3: Link, resolve label references
+            //--------
 
-fail:
-            fo.Dispose();
+            foreach (fixup_t fixup in fixups)
+            {
+                int target;
+
+                if (!labels.TryGetValue(fixup.label, out target))
+                {
+                    LogError(source_path, fixup.line_no, fixup.line, "Label not found [" + fixup.label + "]");
+                    errors++;
+                    continue;
+                }
+
+                inst = code[fixup.index];
+                if (Mnemonic(inst.opcode) == "CALL")
+                {
+                    // Program media address instructions, not bytes
+                    inst.operand = (UInt32)target;
+                }
+                else
+                {
+                    // Skips count the instructions in between
+                    if (target <= fixup.index)
+                    {
+                        LogError(source_path, fixup.line_no, fixup.line, "Skips can only go forward [" + fixup.label + "]");
+                        errors++;
+                        continue;
+                    }
+                    inst.operand = (UInt32)(target - fixup.index - 1);
+                }
+                code[fixup.index] = inst;
+            }
+
+            if (errors > 0)
+            {
+                Console.WriteLine(errors + " error(s), no image written");
+                return false;
+            }
+
+            foreach (KeyValuePair<string, int> kvp in labels)
+                if (!names.ContainsKey(kvp.Value))
+                    names.Add(kvp.Value, kvp.Key.ToLower());
+
+            //--------
+            // Step 4: Verify before anything gets written
+            //--------
+
+            if (!Verify(code, names))
+            {
+                Console.WriteLine("Verification failed, no image written");
+                return false;
+            }
+
+            WriteImage(dest_path, code);
+            Console.WriteLine("Compiled " + lines.Length + " lines into " + code.Count + " instructions (" + (code.Count * INS_SIZE) + " bytes)");
+            return true;
+        }
+
+        // Runs a program, or a sub-routine up to its return, on a model of the interpreter in litterlanguage.c
+        static bool Run(List<instruction_t> code, Dictionary<int, string> names, int entry, bool wet, out run_t run)
+        {
+            Stack<int> calls = new Stack<int>();
+            Stack<int[]> loops = new Stack<int[]>();        // {address, count}
+            string mode = wet ? "wet" : "dry";
+            UInt64 dosage_done = 0;
+            UInt64 dryer_since = 0;
+            UInt64 arm_since = 0;
+            bool dryer = false;
+            bool arm = false;
+            UInt32 arm_position = 0;
+            string error = null;
+            int pc = entry;
+
+            UInt32 DOSAGE_SECONDS_PER_ML;   ResolveOperand  ("DOSAGE_SECONDS_PER_ML", out DOSAGE_SECONDS_PER_ML);
+            UInt32 INS_ARM__STOP;           ResolveOperand  ("INS_ARM__STOP",   out INS_ARM__STOP   );
+            UInt32 INS_ARM__DOWN;           ResolveOperand  ("INS_ARM__DOWN",   out INS_ARM__DOWN   );
+            UInt32 INS_ARM__UP;             ResolveOperand  ("INS_ARM__UP",     out INS_ARM__UP     );
+            UInt32 INS_ARM__HOME;           ResolveOperand  ("INS_ARM__HOME",   out INS_ARM__HOME   );
+            UInt32 INS_ARM__MAX;            ResolveOperand  ("INS_ARM__MAX",    out INS_ARM__MAX    );
+
+            run.ticks = 0;
+            run.water_waits = 0;
+            run.water_fills = 0;
+            run.dosage_ul = 0;
+            run.dryer_ticks = 0;
+            run.arm_ticks = 0;
+
+            if (Mnemonic(code[entry].opcode) == "START")
+                pc++;
+
+            while (error == null)
+            {
+                if (pc >= code.Count)
+                {
+                    error = "Runs off the end of the image";
+                    break;
+                }
+
+                instruction_t inst = code[pc];
+                switch (Mnemonic(inst.opcode))
+                {
+                case "BOWL":
+                case "PUMP":
+                    pc++;
+                    break;
+                case "ARM":
+                    // Up and down run until stopped, positions for the part of the stroke they cover
+                    if (arm)
+                        run.arm_ticks += run.ticks - arm_since;
+                    arm = (inst.operand == INS_ARM__DOWN) || (inst.operand == INS_ARM__UP);
+                    arm_since = run.ticks;
+                    if (inst.operand == INS_ARM__DOWN)
+                        arm_position = INS_ARM__MAX;
+                    else if (inst.operand == INS_ARM__UP)
+                        arm_position = INS_ARM__HOME;
+                    else if ((inst.operand != INS_ARM__STOP) && (inst.operand <= INS_ARM__MAX))
+                    {
+                        run.arm_ticks += (UInt64)ARM_STROKE * (UInt32)Math.Abs((int)inst.operand - (int)arm_position) / INS_ARM__MAX;
+                        arm_position = inst.operand;
+                    }
+                    pc++;
+                    break;
+                case "WATER":
+                    if (wet && (inst.operand != 0))
+                        run.water_fills++;
+                    pc++;
+                    break;
+                case "DRYER":
+                    if (wet)
+                    {
+                        if (dryer)
+                            run.dryer_ticks += run.ticks - dryer_since;
+                        dryer = (inst.operand != 0);
+                        dryer_since = run.ticks;
+                    }
+                    pc++;
+                    break;
+                case "AUTODOSE":
+                    if (wet)
+                    {
+                        dosage_done = run.ticks + (UInt64)inst.operand * TICKS_PER_SECOND * DOSAGE_SECONDS_PER_ML / 10;
+                        run.dosage_ul += (UInt64)inst.operand * 100;
+                    }
+                    pc++;
+                    break;
+                case "WAITTIME":
+                    run.ticks += inst.operand;
+                    pc++;
+                    break;
+                case "WAITWATER":
+                    if (wet)
+                        run.water_waits++;
+                    pc++;
+                    break;
+                case "WAITDOSAGE":
+                    if (wet && (dosage_done > run.ticks))
+                        run.ticks = dosage_done;
+                    pc++;
+                    break;
+                case "SKIPIFDRY":
+                    pc += (wet ? 0 : (int)inst.operand) + 1;
+                    break;
+                case "SKIPIFWET":
+                    pc += (wet ? (int)inst.operand : 0) + 1;
+                    break;
+                case "CALL":
+                    if (calls.Count >= CALL_DEPTH)
+                    {
+                        error = "Sub-routines nested deeper than " + CALL_DEPTH;
+                        break;
+                    }
+                    calls.Push(pc + 1);
+                    pc = (int)inst.operand;
+                    break;
+                case "RETURN":
+                    if ((calls.Count == 0) && (Mnemonic(code[entry].opcode) != "START"))
+                        goto done;
+                    if (calls.Count == 0)
+                    {
+                        error = "INS_RETURN outside a sub-routine";
+                        break;
+                    }
+                    pc = calls.Pop();
+                    break;
+                case "LOOP":
+                    if ((loops.Count >= LOOP_DEPTH) || (inst.operand == 0) || (inst.operand > 0xFF))
+                    {
+                        error = (loops.Count >= LOOP_DEPTH) ? ("Loops nested deeper than " + LOOP_DEPTH) : "Loop count out of range";
+                        break;
+                    }
+                    pc++;
+                    loops.Push(new int[] {pc, (int)inst.operand});
+                    break;
+                case "REPEAT":
+                    if (loops.Count == 0)
+                    {
+                        error = "INS_REPEAT outside a loop";
+                        break;
+                    }
+                    if (--loops.Peek()[1] > 0)
+                        pc = loops.Peek()[0];
+                    else
+                    {
+                        loops.Pop();
+                        pc++;
+                    }
+                    break;
+                case "END":
+                    goto done;
+                case "START":
+                    error = "INS_START inside a program";
+                    break;
+                default:
+                    error = "Opcode not recognized [" + inst.opcode + "]";
+                    break;
+                }
+            }
+
+            Console.WriteLine(Where(names, pc) + " Error: " + error + ", running " + names[entry] + " " + mode);
+            return false;
+
+done:
+            // Whatever still runs is switched off at the end
+            if (dryer)
+                run.dryer_ticks += run.ticks - dryer_since;
+            if (arm)
+                run.arm_ticks += run.ticks - arm_since;
+            return true;
+        }
+
+        static bool Verify(List<instruction_t> code, Dictionary<int, string> names)
+        {
+            int errors = 0;
+            run_t run;
+
+            byte INS_LAST;                  ResolveOpcode   ("INS_LAST",        out INS_LAST        );
+            UInt32 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
+            UInt32 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
+            UInt32 INS_ARM__MAX;            ResolveOperand  ("INS_ARM__MAX",    out INS_ARM__MAX    );
+            UInt32 INS_ARM__UP;             ResolveOperand  ("INS_ARM__UP",     out INS_ARM__UP     );
+            UInt32 BOWL_CCW;                ResolveOperand  ("BOWL_CCW",        out BOWL_CCW        );
+
+            names = NameLabels(code, names);
+
+            //--------
+            // Step 1: Check every instruction on its own
+            //--------
+
+            for (int pc = 0; pc < code.Count; pc++)
+            {
+                instruction_t inst = code[pc];
+                string mnemonic = Mnemonic(inst.opcode);
+                string error = null;
+
+                switch (mnemonic)
+                {
+                case null:
+                    error = "Opcode not recognized [" + inst.opcode + "]";
+                    break;
+                case "START":
+                    if ((inst.operand & 0xFF) > INS_LAST)
+                        error = "Program needs opcodes this interpreter doesn't have";
+                    else if ((inst.operand & (FLAGS_DRYRUN | FLAGS_WETRUN)) == 0)
+                        error = "Program runs in neither wet nor dry mode";
+                    break;
+                case "BOWL":
+                    if (inst.operand > BOWL_CCW)
+                        error = "Bowl operand out of range";
+                    break;
+                case "ARM":
+                    if ((inst.operand > INS_ARM__MAX) && (inst.operand < INS_ARM__UP))
+                        error = "Arm position out of range";
+                    break;
+                case "WATER":
+                case "PUMP":
+                case "DRYER":
+                case "WAITWATER":
+                    if (inst.operand > 1)
+                        error = "Operand must be 0 or 1";
+                    break;
+                case "LOOP":
+                    if ((inst.operand == 0) || (inst.operand > 0xFF))
+                        error = "Loop count out of range";
+                    break;
+                case "CALL":
+                    if (inst.operand >= code.Count)
+                        error = "Call beyond the end of the image";
+                    else if (Mnemonic(code[(int)inst.operand].opcode) == "START")
+                        error = "Call to a program instead of a sub-routine";
+                    break;
+                case "SKIPIFDRY":
+                case "SKIPIFWET":
+                    // The skipped block must lie within the same program or sub-routine, and hold whole loops only
+                    int target = pc + 1 + (int)inst.operand;
+                    int depth = 0;
+
+                    if (target >= code.Count)
+                    {
+                        error = "Skips beyond the end of the image";
+                        break;
+                    }
+                    for (int i = pc + 1; (i < target) && (error == null); i++)
+                    {
+                        switch (Mnemonic(code[i].opcode))
+                        {
+                        case "START":
+                        case "END":
+                        case "RETURN":
+                            error = "Skips " + inst.operand + " instructions, past the end of the block at " + Where(names, i);
+                            break;
+                        case "LOOP":
+                            depth++;
+                            break;
+                        case "REPEAT":
+                            if (--depth < 0)
+                                error = "Skips " + inst.operand + " instructions, out of the loop ending at " + Where(names, i);
+                            break;
+                        }
+                    }
+                    if ((error == null) && (depth > 0))
+                        error = "Skips " + inst.operand + " instructions, into a loop";
+                    break;
+                }
+
+                if (error != null)
+                {
+                    Console.WriteLine(Where(names, pc) + " Error: " + error);
+                    errors++;
+                }
+            }
+
+            if (errors > 0)
+                return false;
+
+            //--------
+            // Step 2: Run every program in each of its modes
+            //--------
+
+            for (int pc = 0; pc < code.Count; pc++)
+            {
+                if (Mnemonic(code[pc].opcode) != "START") continue;
+
+                if (((code[pc].operand & FLAGS_WETRUN) != 0) && !Run(code, names, pc, true, out run)) errors++;
+                if (((code[pc].operand & FLAGS_DRYRUN) != 0) && !Run(code, names, pc, false, out run)) errors++;
+            }
+
+            return (errors == 0);
+        }
+
+        static string FormatTicks(UInt64 ticks)
+        {
+            UInt64 ms = ticks / TICKS_PER_MILISECOND;
+
+            return string.Format("{0}:{1:00}:{2:00}.{3:000}", ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000);
+        }
+
+        // Prints run time and resource use of every program and sub-routine in each mode
+        static void Profile(List<instruction_t> code, Dictionary<int, string> names)
+        {
+            UInt32 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
+            UInt32 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
+            List<int> entries = new List<int>();
+            run_t run;
+
+            names = NameLabels(code, names);
+
+            // Programs first, then the sub-routines they call
+            for (int pc = 0; pc < code.Count; pc++)
+                if (Mnemonic(code[pc].opcode) == "START")
+                    entries.Add(pc);
+            for (int pc = 0; pc < code.Count; pc++)
+                if ((Mnemonic(code[pc].opcode) == "CALL") && (code[pc].operand < code.Count) && !entries.Contains((int)code[pc].operand))
+                    entries.Add((int)code[pc].operand);
+
+            Console.WriteLine("".PadRight(16) + "Mode".PadRight(8) + "Duration".PadRight(16) + "Level waits".PadRight(16) +
+                              "Fills".PadRight(8) + "Detergent".PadRight(12) + "Dryer".PadRight(16) + "Arm");
+
+            foreach (int pc in entries)
+            {
+                for (int mode = 0; mode < 2; mode++)
+                {
+                    bool wet = (mode == 0);
+
+                    // Sub-routines run in whatever mode their caller runs
+                    if ((Mnemonic(code[pc].opcode) == "START") && ((code[pc].operand & (wet ? FLAGS_WETRUN : FLAGS_DRYRUN)) == 0)) continue;
+                    if (!Run(code, names, pc, wet, out run)) continue;
+
+                    Console.WriteLine(names[pc].PadRight(16) + (wet ? "WET" : "DRY").PadRight(8) +
+                                      FormatTicks(run.ticks).PadRight(16) +
+                                      run.water_waits.ToString().PadRight(16) +
+                                      run.water_fills.ToString().PadRight(8) +
+                                      (((decimal)run.dosage_ul / 1000).ToString("0.0", CultureInfo.InvariantCulture) + " ml").PadRight(12) +
+                                      FormatTicks(run.dryer_ticks).PadRight(16) +
+                                      ((decimal)run.arm_ticks / ARM_STROKE).ToString("0.0", CultureInfo.InvariantCulture) + " strokes");
+                }
+            }
+        }
+
+        static void BIN2LLP(string source_path, string dest_path, Dictionary<int, string> known)
+        {
+            List<instruction_t> code = ReadImage(source_path);
+            Dictionary<int, string> names = NameLabels(code, known);
+            TextWriter tw = new StreamWriter(dest_path);
+            string label;
+
+            UInt32 FLAGS_AUTORUN;           ResolveOperand  ("FLAGS_AUTORUN",   out FLAGS_AUTORUN   );
+            UInt32 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
+            UInt32 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
+
+            for (int pc = 0; pc < code.Count; pc++)
+            {
+                instruction_t inst = code[pc];
+                string mnemonic = Mnemonic(inst.opcode);
+                string operand = "";
+
+                if (mnemonic == "START")
+                {
+                    string attributes = "";
+
+                    if ((inst.operand & FLAGS_WETRUN) != 0) attributes += ", WET";
+                    if ((inst.operand & FLAGS_DRYRUN) != 0) attributes += ", DRY";
+                    if ((inst.operand & FLAGS_AUTORUN) != 0) attributes += ", AUTO";
+
+                    if (pc > 0) tw.WriteLine();
+                    tw.WriteLine(FormatLabel(names[pc], (attributes.Length > 0) ? attributes.Substring(2) : ""));
+                    continue;
+                }
+
+                if (names.TryGetValue(pc, out label))
+                {
+                    // Sub-routines are set apart like programs
+                    if ((pc > 0) && (Mnemonic(code[pc - 1].opcode) == "RETURN" || Mnemonic(code[pc - 1].opcode) == "END")) tw.WriteLine();
+                    tw.WriteLine(FormatLabel(label, ""));
+                }
+
+                switch (mnemonic)
+                {
+                case null:
+                    Console.WriteLine(Where(names, pc) + " Error: Opcode not recognized [" + inst.opcode + "]");
+                    tw.WriteLine("// Unknown opcode " + inst.opcode + ", operand " + inst.operand);
+                    continue;
+                case "BOWL":
+                case "PUMP":
+                case "DRYER":
+                case "WATER":
+                    operand = inst.operand.ToString();
+                    foreach (KeyValuePair<string, def_t> kvp in defs) if ((kvp.Value.value == inst.operand) && kvp.Key.StartsWith(mnemonic + '_')) { operand = kvp.Key.Substring(mnemonic.Length + 1); break; }
+                    break;
+                case "ARM":
+                    operand = inst.operand.ToString();
+                    foreach (KeyValuePair<string, def_t> kvp in defs) if ((kvp.Value.value == inst.operand) && kvp.Key.StartsWith("INS_ARM__")) { operand = kvp.Key.Substring(9); break; }
+                    break;
+                case "WAITTIME":
+                    mnemonic = "DELAY";
+                    operand = FormatSeconds((decimal)inst.operand / TICKS_PER_SECOND);
+                    break;
+                case "WAITWATER":
+                    mnemonic = "WAIT";
+                    operand = (inst.operand != 0) ? "WATER_HIGH" : "WATER_LOW";
+                    break;
+                case "WAITDOSAGE":
+                    mnemonic = "WAIT";
+                    operand = "DOSE";
+                    break;
+                case "CALL":
+                    if (!names.TryGetValue((int)inst.operand, out operand))
+                        operand = inst.operand.ToString();
+                    break;
+                case "SKIPIFDRY":
+                case "SKIPIFWET":
+                    if (!names.TryGetValue(pc + 1 + (int)inst.operand, out operand))
+                        operand = inst.operand.ToString();
+                    break;
+                case "RETURN":
+                case "END":
+                case "REPEAT":
+                    break;
+                default:
+                    operand = inst.operand.ToString();
+                    break;
+                }
+
+                tw.WriteLine(FormatStatement(mnemonic, operand));
+            }
+
+            tw.Dispose();
+            Console.WriteLine("Disassembled " + code.Count + " instructions");
         }
 
         static void BIN2C(string source_path, string dest_path)
         {
             FileStream fi = new FileStream(source_path, FileMode.Open);
             TextWriter fo = new StreamWriter(dest_path);
-            byte[] buf = new byte[3];
+            byte[] buf = new byte[INS_SIZE];
             instruction_t inst;
             string opcode;
-            string operand;            
+            string operand;
             UInt16 pc;
             char[] sep = {'_'};
             string[] a;
 
             byte INS_START;                 ResolveOpcode   ("INS_START",       out INS_START       );
-            byte INS_END;                   ResolveOpcode   ("INS_END",         out INS_END         );
-            UInt16 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
-            UInt16 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
+            byte INS_LAST;                  ResolveOpcode   ("INS_LAST",        out INS_LAST        );
+            UInt32 FLAGS_DRYRUN;            ResolveOperand  ("FLAGS_DRYRUN",    out FLAGS_DRYRUN    );
+            UInt32 FLAGS_WETRUN;            ResolveOperand  ("FLAGS_WETRUN",    out FLAGS_WETRUN    );
 
             fo.WriteLine("#include \"" + Path.GetFileNameWithoutExtension(source_path) + ".h\"");
             fo.WriteLine();
-            fo.WriteLine("const struct instruction clean_program = {");
-            
+            fo.WriteLine("const unsigned char clean_program[] = {");
+
             pc = 0;
-            while (fi.Read(buf, 0, 3) == 3)
+            while (fi.Read(buf, 0, INS_SIZE) == INS_SIZE)
             {
                 inst.opcode = buf[0];
                 inst.operand = buf[1];
                 inst.operand <<= 8;
                 inst.operand |= buf[2];
+                inst.operand <<= 8;
+                inst.operand |= buf[3];
 
                 // Lookup opcode
-                opcode = null;
-                foreach (KeyValuePair<string, def_t> kvp in defs) if ((kvp.Value.source != null) && (kvp.Value.value == inst.opcode) && kvp.Key.StartsWith("INS_")) { opcode = kvp.Key; break; }
+                opcode = Mnemonic(inst.opcode);
                 if (opcode == null)
                 {
                     Console.WriteLine("(pc=" + pc.ToString() + ") Error: Opcode not recognized [" + inst.opcode +"]");
                     goto fail;
                 }
+                opcode = "INS_" + opcode;
 
                 // Lookup operand
                 a = opcode.Split(sep, 2);
@@ -535,24 +1337,33 @@ fail:
                     operand = "";
 
                     // TBD: Support additional attribs here
-                    if ((inst.operand & INS_END) > 0) operand += "INS_END | ";
+                    if ((inst.operand & 0xFF) == INS_LAST) operand += "INS_LAST | ";
                     if ((inst.operand & FLAGS_DRYRUN) > 0) operand += "FLAGS_DRYRUN | ";
                     if ((inst.operand & FLAGS_WETRUN) > 0) operand += "FLAGS_WETRUN | ";
 
                     if (operand.Length > 0) operand = operand.Substring(0, operand.Length - 3);
                 }
+                else if ((opcode == "INS_WAITTIME") && ((inst.operand % TICKS_PER_MILISECOND) == 0))
+                {
+                    operand = "MS(" + (inst.operand / TICKS_PER_MILISECOND).ToString() + ")";
+                }
+                else if (opcode == "INS_ARM")
+                {
+                    operand = inst.operand.ToString();
+                    foreach (KeyValuePair<string, def_t> kvp in defs) if ((kvp.Value.source != null) && (kvp.Value.value == inst.operand) && kvp.Key.StartsWith("INS_ARM__")) { operand = kvp.Key; break; }
+                }
                 else
                 {
                     operand = inst.operand.ToString();
                     foreach (KeyValuePair<string, def_t> kvp in defs) if ((kvp.Value.source != null) && (kvp.Value.value == inst.operand) && kvp.Key.StartsWith(a[1] + '_')) { operand = kvp.Key; break; }
                 }
 
-                fo.WriteLine("".PadRight(8) + ("/* " + pc.ToString().PadLeft(4, '0') + " */").PadRight(16) + ("{" + opcode + ",").PadRight(16) + operand + "},");
-                
-                pc += 3;
+                // Program addresses are instruction indices
+                fo.WriteLine("".PadRight(8) + ("/* " + pc.ToString().PadLeft(4, '0') + " */").PadRight(16) + ("INS(" + opcode.Substring(4) + ",").PadRight(16) + operand + "),");
+
+                pc++;
             }
 
-            fo.WriteLine("".PadRight(24) + "{0x00,".PadRight(16) + "0x0000}");
             fo.WriteLine("};");
 
 fail:
@@ -571,15 +1382,16 @@ fail:
             defs.Add(key, def);
         }
 
-        static void Main(string[] args)
+        static int Main(string[] args)
         {
             string m_AppPath;
             string m_SoftwarePath;
             string m_CGPath;
             string m_CommonPath;
+            Dictionary<int, string> names = new Dictionary<int, string>();
 
             m_AppPath = AppDomain.CurrentDomain.BaseDirectory;
-            
+
             // Resolve paths
             Console.WriteLine("* Resolving paths");
             m_SoftwarePath = Path.GetFullPath(m_AppPath + "\\..\\..\\..\\..\\software");
@@ -587,7 +1399,7 @@ fail:
             m_CommonPath = m_SoftwarePath + "\\common";
 
             // Load defines
-            Console.WriteLine("* Loading defines"); 
+            Console.WriteLine("* Loading defines");
             ParseDefines(m_CGPath + "\\litterlanguage.h");
             ParseDefines(m_CommonPath + "\\catgenie120.h");
 
@@ -596,22 +1408,74 @@ fail:
             AddCustomDef("PUMP_OFF", 0);
             AddCustomDef("DRYER_ON", 1);
             AddCustomDef("DRYER_OFF", 0);
-
-            // WAIT intructions
             AddCustomDef("WATER_ON", 1);
             AddCustomDef("WATER_OFF", 0);
+
+            // WAIT intructions
             AddCustomDef("WATER_HIGH", 1);
             AddCustomDef("WATER_LOW", 0);
             AddCustomDef("DOSAGE", 0);
             AddCustomDef("DOSE", 0);
 
+            // Files given: Convert each one step, .c to .llp, .llp to .bin and .bin back to .llp
+            if (args.Length > 0)
+            {
+                int failed = 0;
+
+                foreach (string path in args)
+                {
+                    string ext = Path.GetExtension(path).ToLower();
+
+                    names.Clear();
+                    if (ext == ".c")
+                    {
+                        Console.WriteLine("* Converting " + path + " to LLP");
+                        if (!C2LLP(path, Path.ChangeExtension(path, ".llp"))) failed++;
+                    }
+                    else if (ext == ".llp")
+                    {
+                        Console.WriteLine("* Assembling " + path);
+                        if (LLP2BIN(path, Path.ChangeExtension(path, ".bin"), names))
+                            Profile(ReadImage(Path.ChangeExtension(path, ".bin")), names);
+                        else
+                            failed++;
+                    }
+                    else if (ext == ".bin")
+                    {
+                        Console.WriteLine("* Disassembling " + path);
+                        if (Verify(ReadImage(path), names))
+                            Profile(ReadImage(path), names);
+                        else
+                            failed++;
+                        BIN2LLP(path, Path.ChangeExtension(path, ".dis.llp"), names);
+                    }
+                    else
+                    {
+                        Console.WriteLine("Error: Don't know what to do with [" + path + "]");
+                        failed++;
+                    }
+                }
+
+                return (failed > 0) ? 1 : 0;
+            }
+
             // Convert C to LLP
             Console.WriteLine("* Converting C to LLP");
-            C2LLP(m_CGPath + "\\romwashprogram.c", m_AppPath + "\\clean_default.llp");
+            if (!C2LLP(m_CGPath + "\\romwashprogram.c", m_AppPath + "\\clean_default.llp"))
+                return 1;
 
             // Convert LLP to BIN
             Console.WriteLine("* Converting LLP to BIN");
-            LLP2BIN(m_AppPath + "\\clean_default.llp", m_AppPath + "\\clean_default.bin");
+            if (!LLP2BIN(m_AppPath + "\\clean_default.llp", m_AppPath + "\\clean_default.bin", names))
+                return 1;
+
+            // Time the programs
+            Console.WriteLine("* Timing programs");
+            Profile(ReadImage(m_AppPath + "\\clean_default.bin"), names);
+
+            // Convert BIN back to LLP
+            Console.WriteLine("* Converting BIN to LLP");
+            BIN2LLP(m_AppPath + "\\clean_default.bin", m_AppPath + "\\clean_default.dis.llp", names);
 
             // Convert BIN to HEX?
 
@@ -619,14 +1483,8 @@ fail:
             Console.WriteLine("* Converting BIN to C");
             BIN2C(m_AppPath + "\\clean_default.bin", m_AppPath + "\\clean_default.c");
 
-            /*
-            foreach (KeyValuePair<string, UInt16> kvp in defs)
-            {
-                Console.WriteLine(kvp.Key + "=[" + kvp.Value + "]");
-            }
-             */
-
             //Console.ReadKey();
+            return 0;
         }
     }
 }
@@ -0,0 +1,29 @@
+/******************************************************************************/
+/* File    :	catgenius_sim.c						      */
+/* Function:	CatGenius application wrapper for the host simulator	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+
+/*
+ * The application is compiled as-is. Its main() is renamed so the simulator
+ * can own the process entry point, and its (static) interrupt service routine
+ * is exported for the simulator to dispatch emulated interrupts to.
+ */
+#define main	catgenius_main
+#include "../catgenius/catgenius.c"
+#undef main
+
+#include "simulator.h"
+
+
+void sim_firmware (void)
+{
+	catgenius_main();
+}
+
+
+void sim_isr (void)
+{
+	isr();
+}
@@ -0,0 +1,178 @@
+/******************************************************************************/
+/* File    :	cr14_sim.c						      */
+/* Function:	Model of the CR14 RFID reader with an SRIX4K in its field     */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+
+/*
+ * Stands in for cr14.c in the simulator build. The reader is modelled at the
+ * level of its frame interface: every call spends the time of its I2C
+ * transfer, and after a frame is written the answer of the tag only becomes
+ * available once its RF exchange is over. Until then the reader does not
+ * acknowledge its address, just like the real one. A tag is present when an
+ * image was loaded with '-r'.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <htc.h>
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "../common/cr14.h"
+#include "../common/timer.h"
+#include "simulator.h"
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+#define TAG_BLOCKS		128
+#define BLOCK_SIZE		4
+#define CHIP_ID			0x42
+
+#define I2C_BYTE_US		90		/* 9 bits at 100kHz */
+#define RF_TIME			(2 * MILISECOND)	/* Frame exchange with the tag */
+
+#define CMD_INITIATE		0x06
+#define CMD_READBLOCK		0x08
+#define CMD_WRITEBLOCK		0x09
+#define CMD_GETUID		0x0B
+#define CMD_SELECT		0x0E
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+static unsigned char		tag[TAG_BLOCKS * BLOCK_SIZE];
+static unsigned char		tag_present	= 0;
+static unsigned char		selected	= 0;
+static unsigned char		paramreg	= 0;
+static unsigned char		answer[8];
+static unsigned char		answer_len	= 0;
+static unsigned long long	answer_time	= 0;
+
+unsigned long			sim_tag_reads	= 0;
+
+
+/******************************************************************************/
+/* Local Prototypes							      */
+/******************************************************************************/
+
+static void	transfer	(unsigned char	bytes);
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+int sim_tag_load (const char *path)
+{
+	FILE	*file;
+
+	memset(tag, 0xFF, sizeof(tag));
+	if (!(file = fopen(path, "rb")))
+		return -1;
+	fread(tag, 1, sizeof(tag), file);
+	fclose(file);
+	tag_present = 1;
+	return 0;
+}
+
+
+unsigned char cr14_writeparamreg (unsigned char regval)
+{
+	transfer(3);
+	paramreg = regval;
+	if (!(paramreg & 0x10)) {
+		/* Carrier off resets the tag */
+		selected = 0;
+		answer_len = 0;
+	}
+	return CR14_OK;
+}
+
+
+unsigned char cr14_readparamreg (unsigned char *regval)
+{
+	transfer(4);
+	*regval = paramreg;
+	return CR14_OK;
+}
+
+
+unsigned char cr14_writeframe (unsigned char *frame_ptr, unsigned char frame_len)
+{
+	transfer(3 + frame_len);
+	if (sim_now() < answer_time)
+		return CR14_BUSY;
+
+	answer_len = 0;
+	answer_time = sim_now() + RF_TIME;
+	if (!(paramreg & 0x10) || !tag_present || !frame_len)
+		return CR14_OK;
+
+	switch (frame_ptr[0]) {
+	case CMD_INITIATE:
+		selected = 0;
+		answer[0] = CHIP_ID;
+		answer_len = 1;
+		break;
+	case CMD_SELECT:
+		if ((frame_len == 2) && (frame_ptr[1] == CHIP_ID)) {
+			selected = 1;
+			answer[0] = CHIP_ID;
+			answer_len = 1;
+		}
+		break;
+	case CMD_GETUID:
+		if (selected) {
+			memcpy(answer, "\x01\x23\x45\x67\x89\xAB\x02\xD0", 8);
+			answer_len = 8;
+		}
+		break;
+	case CMD_READBLOCK:
+		if (selected && (frame_len == 2) && (frame_ptr[1] < TAG_BLOCKS)) {
+			memcpy(answer, &tag[frame_ptr[1] * BLOCK_SIZE], BLOCK_SIZE);
+			answer_len = BLOCK_SIZE;
+			sim_tag_reads++;
+		}
+		break;
+	case CMD_WRITEBLOCK:
+		if (selected && (frame_len == 2 + BLOCK_SIZE) && (frame_ptr[1] < TAG_BLOCKS))
+			memcpy(&tag[frame_ptr[1] * BLOCK_SIZE], &frame_ptr[2], BLOCK_SIZE);
+		break;
+	}
+	return CR14_OK;
+}
+
+
+unsigned char cr14_readframe (unsigned char *frame_ptr, unsigned char *frame_len)
+{
+	if (sim_now() < answer_time) {
+		/* Address not acknowledged while the RF exchange runs */
+		transfer(1);
+		return CR14_BUSY;
+	}
+
+	if (answer_len < *frame_len)
+		*frame_len = answer_len;
+	memcpy(frame_ptr, answer, *frame_len);
+	transfer(3 + *frame_len);
+	answer_len = 0;
+	return CR14_OK;
+}
+
+
+/******************************************************************************/
+/* Local Implementations						      */
+/******************************************************************************/
+
+static void transfer (unsigned char bytes)
+{
+	sim_delay_us((unsigned long)bytes * I2C_BYTE_US);
+}
@@ -0,0 +1,113 @@
+/******************************************************************************/
+/* File    :	htc.h							      */
+/* Function:	Host replacement for the HI-TECH C device header	      */
+/******************************************************************************/
+
+#ifndef HTC_H				/* Include file already compiled? */
+#define HTC_H
+
+/*
+ * This header stands in for HI-TECH C's <htc.h> when the firmware is built
+ * for the host. It maps the compiler extensions onto plain C and declares the
+ * special function registers of the PIC16F1939 as ordinary variables. The
+ * register file itself lives in simulator.c, which also moves them along with
+ * virtual time. Like HI-TECH's, printf() sends its output through putch(), so
+ * it takes the time the EUSART needs to send it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#if !(defined _16F1939)
+#  error The simulator only emulates a PIC16F1939
+#endif
+
+/* Compiler extensions */
+#define bit			unsigned char
+#define interrupt
+#define __CONFIG(x)
+#define stricmp			strcasecmp
+#define printf			sim_printf
+
+/* Built-in functions */
+#define CLRWDT()		sim_clrwdt()
+#define NOP()
+#define SLEEP()			sim_sleep()
+#define __delay_us(x)		sim_delay_us((unsigned long)(x))
+#define __delay_ms(x)		sim_delay_us((unsigned long)(x) * 1000UL)
+#define eeprom_read(addr)	sim_eeprom_read(addr)
+#define eeprom_write(addr,val)	sim_eeprom_write(addr, val)
+#define WR			sim_eeprom_busy()	/* EECON1, read-only here */
+
+/* Register file */
+#define SIM_REGISTERS(reg) \
+	reg(PORTA) reg(PORTB) reg(PORTC) reg(PORTD) reg(PORTE) \
+	reg(LATA) reg(LATB) reg(LATC) reg(LATD) reg(LATE) \
+	reg(TRISA) reg(TRISB) reg(TRISC) reg(TRISD) reg(TRISE) \
+	reg(ANSELA) reg(ANSELB) reg(ANSELD) reg(ANSELE) reg(WPUB) reg(WPUE) \
+	reg(IOCBP) reg(IOCBN) reg(IOCBF) \
+	reg(TMR1L) reg(TMR1H) reg(PR2) reg(T2CON) reg(CCPR1L) reg(CCP1CON) \
+	reg(SPBRG) reg(SPBRGH) \
+	reg(SSPCON) reg(SSPCON2) reg(SSPADD) reg(SSPBUF) reg(ADCON1) \
+	reg(WDTCON)
+
+#define SIM_BITS(reg) \
+	reg(GIE) reg(PEIE) reg(nPOR) reg(nBOR) reg(nTO) reg(nWPUEN) \
+	reg(TMR1CS0) reg(TMR1CS1) reg(T1CKPS0) reg(T1CKPS1) reg(T1OSCEN) \
+	reg(nT1SYNC) reg(TMR1ON) reg(TMR1IE) reg(TMR1IF) \
+	reg(TMR2ON) reg(TMR2IE) reg(TMR2IF) reg(IOCIE) reg(IOCIF) \
+	reg(RCIE) reg(RCIF) reg(TXIE) reg(OERR) reg(FERR) \
+	reg(BRG16) reg(CSRC) reg(BRGH) reg(SYNC) reg(SPEN) reg(RX9) reg(TX9) \
+	reg(CREN) reg(TXEN) reg(WUE) \
+	reg(SEN) reg(RSEN) reg(PEN) reg(RCEN) reg(ACKEN) reg(ACKDT) \
+	reg(ACKSTAT) reg(R_nW) reg(CKE) reg(SMP) reg(SSPIF) reg(BCLIF)
+
+#define SIM_DECLARE(name)	extern volatile unsigned char name;
+SIM_REGISTERS(SIM_DECLARE)
+SIM_BITS(SIM_DECLARE)
+#undef SIM_DECLARE
+
+extern volatile unsigned int	ADRES;
+
+/* Transmitter: TXREG reads SIM_TXREG_EMPTY when empty */
+#define SIM_TXREG_EMPTY		0x100
+extern volatile unsigned int	TXREG;
+#define TXIF			sim_txif()
+#define TRMT			sim_trmt()
+
+/* Receiver: reading RCREG clears RCIF */
+#define RCREG			sim_rcreg()
+
+extern volatile struct adcon0bits {
+	unsigned	ADON	: 1;
+	unsigned	CHS	: 5;
+	union {
+		unsigned	GO	: 1;
+		unsigned	nDONE	: 1;
+	};
+} ADCON0bits;
+
+extern volatile struct adcon1bits {
+	unsigned	ADPREF	: 2;
+	unsigned	ADNREF	: 1;
+	unsigned	ADCS	: 3;
+	unsigned	ADFM	: 1;
+} ADCON1bits;
+
+/* Simulator services used by the macros above */
+void		sim_clrwdt		(void) ;
+void		sim_sleep		(void) ;
+void		sim_delay_us		(unsigned long	us) ;
+unsigned char	sim_txif		(void) ;
+unsigned char	sim_trmt		(void) ;
+unsigned char	sim_rcreg		(void) ;
+int		sim_printf		(const char	*format,
+					 ...) ;
+void		putch			(char		c) ;
+unsigned char	sim_eeprom_busy		(void) ;
+unsigned char	sim_eeprom_read		(unsigned char	addr) ;
+void		sim_eeprom_write	(unsigned char	addr,
+					 unsigned char	value) ;
+
+#endif /* HTC_H */
@@ -0,0 +1,703 @@
+/******************************************************************************/
+/* File    :	simulator.c						      */
+/* Function:	Host simulator of the CatGenie 120 controller board	      */
+/* History :	16 Oct 2026:						      */
+/*		- Initial revision.					      */
+/******************************************************************************/
+
+/*
+ * The simulator runs the unmodified firmware on the host against an emulated
+ * register file. Time is virtual: every pass through the firmware's main loop
+ * (marked by CLRWDT()) and every __delay_xx() advances Timer1 by a fixed
+ * number of ticks, so a complete washing program finishes in a fraction of
+ * its wall-clock time. SLEEP() stops Timer1 and lasts for the watchdog
+ * period, or until an enabled interrupt-on-change or a start bit on the
+ * receiver (with WUE set) wakes the processor up. Like on the chip, the
+ * character that wakes up the receiver is lost, so a script should lead what
+ * it types at an idle box with a spare one, like '!send 20'. The transmitter
+ * shifts out a character in ten bit times, so TXREG empties for the next one
+ * only when the previous one is done. An EEPROM write keeps WR set for the
+ * write time, and like HI-TECH's eeprom_read() and eeprom_write(), the next
+ * access waits for it.
+ *
+ * Usage: catgenius_sim [-t seconds] [-q ticks] [-e eeprom.bin] [-r tag.bin] [-v] [script]
+ *   -t	Virtual run time in seconds (default 3600)
+ *   -q	Timer1 ticks per main loop pass (default 125, which is 1ms)
+ *   -e	File to load the EEPROM from and save it to at exit
+ *   -r	Image of the SRIX4K tag on the cartridge (see cr14_sim.c)
+ *   -v	Trace actuator changes with their virtual time stamp
+ *
+ * The script (use '-' for stdin) contains one line per action, optionally
+ * preceded by '@<seconds>' to hold it until that virtual time. Lines are
+ * typed into the serial command line, except for these directives:
+ *   !cat in|out		Cat enters or leaves the box
+ *   !start down|up		Start button pressed or released
+ *   !setup down|up		Setup button pressed or released
+ *   !supply off|on		Water supply shut off or restored
+ *   !send <hex bytes>	Send raw bytes, like 05 for ENQ
+ *   !frame <hex bytes>	Send type and payload as a frame (see frame.c)
+ *   !quit			End the simulation
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <htc.h>
+
+#include "../common/hardware.h"		/* Flexible hardware configuration */
+
+#include "../common/timer.h"
+#include "simulator.h"
+
+
+/******************************************************************************/
+/* Macros								      */
+/******************************************************************************/
+
+#define DEFAULT_RUNTIME		3600		/* Seconds */
+#define DEFAULT_QUANTUM		(SECOND/1000)	/* Ticks per main loop pass */
+#define EEPROM_SIZE		256
+#define EEPROM_WRITETIME	(4 * MILISECOND)	/* Typical, see datasheet */
+#define SCRIPT_MAX		256
+#define LINE_MAX		80
+
+#define SIM_FILLTIME		(40UL * SECOND)	/* Time for the bowl to fill up */
+#define SIM_DRAINTIME		(6UL * SECOND)	/* Time for the pump to empty it */
+#define ADC_DRY			22		/* See water.h */
+#define ADC_SUBMERGED		1023		/* See water.h */
+#define SIM_CHARTIME		((10UL * SECOND + BITRATE / 2) / BITRATE) /* Start, 8 data, stop */
+
+
+/******************************************************************************/
+/* Global Data								      */
+/******************************************************************************/
+
+/* Register file */
+#define SIM_DEFINE(name)	volatile unsigned char name;
+SIM_REGISTERS(SIM_DEFINE)
+SIM_BITS(SIM_DEFINE)
+#undef SIM_DEFINE
+
+volatile unsigned int		ADRES;
+volatile unsigned int		TXREG		= SIM_TXREG_EMPTY;
+volatile struct adcon0bits	ADCON0bits;
+volatile struct adcon1bits	ADCON1bits;
+
+struct scriptline {
+	unsigned long long	time;
+	char			text[LINE_MAX];
+};
+
+static unsigned long long	now		= 0;
+static unsigned long long	limit		= 0;
+static unsigned long		quantum		= DEFAULT_QUANTUM;
+static unsigned long		us_remainder	= 0;
+static unsigned long		passes		= 0;
+static unsigned long		sleeps		= 0;
+static unsigned long long	asleep		= 0;
+static unsigned char		sleeping	= 0;
+static unsigned char		verbose		= 0;
+
+static unsigned char		eeprom[EEPROM_SIZE];
+static const char		*eeprom_file	= NULL;
+static unsigned long long	eeprom_ready	= 0;	/* End of the running write */
+static unsigned long		eeprom_writes	= 0;
+static unsigned long long	eeprom_stalled	= 0;
+
+static unsigned long long	tx_done		= 0;	/* End of the character being sent */
+static char			tx_line[LINE_MAX];	/* Sent, but not printed yet */
+static unsigned int		tx_len		= 0;
+
+static struct scriptline	script[SCRIPT_MAX];
+static unsigned int		script_len	= 0;
+static unsigned int		script_pos	= 0;
+static const char		*rx_feed	= NULL;
+static unsigned int		rx_left		= 0;	/* Characters left to type */
+static unsigned char		rx_reg		= 0;	/* RCREG */
+static char			rx_raw[LINE_MAX];	/* Bytes of !send and !frame */
+
+static unsigned char		pins_b		= BIT(STARTBUTTON_BIT) |
+						  BIT(SETUPBUTTON_BIT) |
+						  HEATSENSOR_MASK |
+						  CATSENSOR_MASK |
+						  NOT_USED_3_MASK |
+						  NOT_USED_4_MASK;
+static unsigned char		portb_old;
+static unsigned char		cat_present	= 0;
+static unsigned long		water_level	= 0;
+static unsigned char		water_supply	= 1;
+static unsigned char		latd_old	= 0;
+
+static clock_t			host_start;
+
+
+/******************************************************************************/
+/* Local Prototypes							      */
+/******************************************************************************/
+
+static void	transmitter	(void);
+static void	eeprom_wait	(void);
+static void	load_script	(const char	*path);
+static void	run_script	(unsigned char	feed);
+static void	feed_raw	(const char	*text,
+				 unsigned char	frame);
+static void	directive	(const char	*text);
+static void	peripherals	(unsigned long	ticks);
+static void	refresh_ports	(void);
+static unsigned char	pending	(void);
+static void	interrupts	(void);
+static void	finish		(void);
+static void	print_time	(FILE		*stream,
+				 unsigned long long ticks);
+
+
+/******************************************************************************/
+/* Global Implementations						      */
+/******************************************************************************/
+
+int main (int argc, char *argv[])
+{
+	unsigned long	runtime = DEFAULT_RUNTIME;
+	int		arg;
+	FILE		*file;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-t") && (arg + 1 < argc))
+			runtime = strtoul(argv[++arg], NULL, 0);
+		else if (!strcmp(argv[arg], "-q") && (arg + 1 < argc))
+			quantum = strtoul(argv[++arg], NULL, 0);
+		else if (!strcmp(argv[arg], "-e") && (arg + 1 < argc))
+			eeprom_file = argv[++arg];
+		else if (!strcmp(argv[arg], "-r") && (arg + 1 < argc)) {
+			if (sim_tag_load(argv[++arg])) {
+				perror(argv[arg]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[arg], "-v"))
+			verbose = 1;
+		else if ((argv[arg][0] != '-') || !strcmp(argv[arg], "-"))
+			load_script(argv[arg]);
+		else {
+			fprintf(stderr, "Usage: %s [-t seconds] [-q ticks] [-e eeprom.bin] [-r tag.bin] [-v] [script]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!quantum)
+		quantum = 1;
+	limit = (unsigned long long)runtime * SECOND;
+
+	/* Erased EEPROM, unless a saved image is provided */
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	if (eeprom_file && (file = fopen(eeprom_file, "rb"))) {
+		fread(eeprom, 1, sizeof(eeprom), file);
+		fclose(file);
+	}
+
+	/* Power-on reset state */
+	nPOR  = 0;
+	nBOR  = 0;
+	nTO   = 1;
+	WDTCON = 0x16;	/* 1:65536, 2s */
+	ACKSTAT = 1;	/* No I2C devices present */
+	TRISA = TRISB = TRISC = TRISD = TRISE = 0xFF;
+	refresh_ports();
+	portb_old = PORTB;
+
+	host_start = clock();
+	sim_firmware();
+
+	/* Firmware is not supposed to return */
+	finish();
+	return 0;
+}
+
+
+unsigned long long sim_now (void)
+{
+	return now;
+}
+
+
+void sim_advance (unsigned long ticks)
+/******************************************************************************/
+/* Function:	sim_advance						      */
+/*		- Move virtual time forward, running the peripherals along    */
+/******************************************************************************/
+{
+	unsigned long	step;
+	unsigned long	timer1;
+
+	while (ticks) {
+		transmitter();
+
+		step = ticks;
+		timer1 = ((unsigned long)TMR1H << 8) | TMR1L;
+		/* Stop at each Timer1 overflow, so each gets its own interrupt */
+		if (TMR1ON && !sleeping && (step > 0x10000UL - timer1))
+			step = 0x10000UL - timer1;
+		/* Stop when TXREG empties, for the next character to follow */
+		if ((TXREG != SIM_TXREG_EMPTY) && (step > tx_done - now))
+			step = (unsigned long)(tx_done - now);
+
+		now   += step;
+		ticks -= step;
+		/* Timer1 runs on the instruction clock, which stops during sleep */
+		if (TMR1ON && !sleeping) {
+			timer1 += step;
+			if (timer1 >= 0x10000UL) {
+				timer1 -= 0x10000UL;
+				TMR1IF = 1;
+			}
+			TMR1L = timer1 & 0xFF;
+			TMR1H = (timer1 >> 8) & 0xFF;
+		}
+
+		peripherals(step);
+		interrupts();
+	}
+}
+
+
+void sim_clrwdt (void)
+/******************************************************************************/
+/* Function:	sim_clrwdt						      */
+/*		- Marks the end of a main loop pass			      */
+/******************************************************************************/
+{
+	/* The ones around SLEEP run with interrupts disabled, not a pass */
+	if (!GIE)
+		return;
+
+	passes++;
+	run_script(1);
+	sim_advance(quantum);
+
+	if (now >= limit)
+		finish();
+}
+
+
+void sim_sleep (void)
+/******************************************************************************/
+/* Function:	sim_sleep						      */
+/*		- Sleeps until the watchdog or an enabled interrupt wakes up  */
+/******************************************************************************/
+{
+	unsigned long long	wake;
+	unsigned long long	start = now;
+
+	/* Watchdog prescaler 1:32 is 1ms */
+	wake = now + ((unsigned long long)(SECOND / 1000) << ((WDTCON >> 1) & 0x1F));
+	nTO = 1;
+	sleeping = 1;
+	/* An enabled interrupt that is already pending makes SLEEP a NOP */
+	while (!pending() && (now < wake)) {
+		/* Script lines become due, but characters can't be received */
+		run_script(0);
+		if (IOCIF && IOCIE)
+			break;
+		if (WUE && rx_feed) {
+			/* The start bit wakes up the receiver, which misses
+			 * the character itself and leaves junk in RCREG */
+			WUE = 0;
+			rx_reg = 0x00;
+			RCIF = 1;
+			if (!--rx_left)
+				rx_feed = NULL;
+			else
+				rx_feed++;
+			break;
+		}
+		sim_advance(((wake - now) < quantum) ? (unsigned long)(wake - now) : quantum);
+		if (now >= limit)
+			break;
+	}
+	if (now >= wake)
+		nTO = 0;
+	sleeping = 0;
+	sleeps++;
+	asleep += now - start;
+
+	/* The firmware enables interrupts right after waking up, before it
+	 * takes its next timestamp, so a Timer1 overflow is served now */
+	if (TMR1IF && TMR1IE) {
+		GIE = 0;
+		sim_isr();
+		GIE = 1;
+	}
+
+	if (now >= limit)
+		finish();
+}
+
+
+void sim_delay_us (unsigned long us)
+{
+	unsigned long long	ticks;
+
+	ticks = (unsigned long long)us * SECOND + us_remainder;
+	us_remainder = ticks % 1000000UL;
+	sim_advance(ticks / 1000000UL);
+}
+
+
+unsigned char sim_txif (void)
+{
+	transmitter();
+	if (TXREG == SIM_TXREG_EMPTY) {
+		/* The interrupt for an empty TXREG is taken before the poll */
+		interrupts();
+		return 1;
+	}
+
+	/* Each poll takes a tick, so loops waiting for it move time along */
+	sim_advance(1);
+	return 0;
+}
+
+
+unsigned char sim_trmt (void)
+{
+	transmitter();
+	return ((TXREG == SIM_TXREG_EMPTY) && (now >= tx_done));
+}
+
+
+unsigned char sim_rcreg (void)
+{
+	RCIF = 0;
+	return rx_reg;
+}
+
+
+int sim_printf (const char *format, ...)
+{
+	char	text[256];
+	va_list	args;
+	int	len;
+	int	index;
+
+	va_start(args, format);
+	len = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	for (index = 0; text[index]; index++)
+		putch(text[index]);
+
+	return len;
+}
+
+
+unsigned char sim_eeprom_busy (void)
+{
+	return (now < eeprom_ready);
+}
+
+
+unsigned char sim_eeprom_read (unsigned char addr)
+{
+	eeprom_wait();
+	return eeprom[addr];
+}
+
+
+void sim_eeprom_write (unsigned char addr, unsigned char value)
+{
+	eeprom_wait();
+	eeprom[addr] = value;
+	eeprom_ready = now + EEPROM_WRITETIME;
+	eeprom_writes++;
+}
+
+
+/******************************************************************************/
+/* Local Implementations						      */
+/******************************************************************************/
+
+static void transmitter (void)
+{
+	/* TXREG moves into the shift register once that is done */
+	if ((TXREG != SIM_TXREG_EMPTY) && (now >= tx_done)) {
+		/* Whole lines, so traces don't end up halfway one */
+		tx_line[tx_len++] = (char)TXREG;
+		if ((TXREG == '\n') || (tx_len == sizeof(tx_line))) {
+			fwrite(tx_line, 1, tx_len, stdout);
+			tx_len = 0;
+		}
+		TXREG = SIM_TXREG_EMPTY;
+		tx_done = now + SIM_CHARTIME;
+	}
+}
+
+
+static void eeprom_wait (void)
+{
+	/* The CPU spins on WR until the running write is done */
+	if (now < eeprom_ready) {
+		eeprom_stalled += eeprom_ready - now;
+		sim_advance((unsigned long)(eeprom_ready - now));
+	}
+}
+
+
+static void load_script (const char *path)
+{
+	FILE			*file;
+	char			line[LINE_MAX];
+	char			*text;
+	unsigned long long	time = 0;
+
+	file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!file) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), file) && (script_len < SCRIPT_MAX)) {
+		line[strcspn(line, "\r\n")] = 0;
+		text = line;
+		if (*text == '@')
+			time = (unsigned long long)(strtod(text + 1, &text) * SECOND);
+		text += strspn(text, " \t");
+		if (!*text || (*text == '#'))
+			continue;
+		script[script_len].time = time;
+		snprintf(script[script_len].text, LINE_MAX, "%s\r", text);
+		script_len++;
+	}
+
+	if (file != stdin)
+		fclose(file);
+}
+
+
+static void run_script (unsigned char feed)
+{
+	/* Type the current line, one character per pass */
+	if (rx_feed) {
+		if (!feed)
+			return;
+		if (RCIE && !RCIF) {
+			rx_reg = (unsigned char)*rx_feed++;
+			RCIF  = 1;
+			if (!--rx_left)
+				rx_feed = NULL;
+		}
+		return;
+	}
+
+	/* Start the next line when it's due */
+	if ((script_pos < script_len) && (script[script_pos].time <= now)) {
+		if (script[script_pos].text[0] == '!')
+			directive(script[script_pos].text + 1);
+		else {
+			rx_feed = script[script_pos].text;
+			rx_left = strlen(rx_feed);
+		}
+		script_pos++;
+	}
+}
+
+
+static void feed_raw (const char *text, unsigned char frame)
+{
+	unsigned char	bytes[LINE_MAX];
+	char		*end;
+	unsigned int	length = 0;
+	unsigned int	index;
+	unsigned int	crc = 0xFFFF;
+	unsigned char	bits;
+
+	for (;;) {
+		bytes[length + 1] = (unsigned char)strtoul(text, &end, 16);
+		if ((end == text) || (length + 1 >= sizeof(bytes) / 2 - 3))
+			break;
+		text = end;
+		length++;
+	}
+	if (!length)
+		return;
+	if (!frame) {
+		memcpy(rx_raw, bytes + 1, length);
+		rx_feed = rx_raw;
+		rx_left = length;
+		return;
+	}
+
+	/* Frames are SOH, length, type, payload, CRC-16/CCITT, escaped */
+	bytes[0] = (unsigned char)(length - 1);
+	for (index = 0; index <= length; index++) {
+		crc ^= bytes[index] << 8;
+		for (bits = 0; bits < 8; bits++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+	}
+	bytes[++length] = (unsigned char)(crc >> 8);
+	bytes[++length] = (unsigned char)crc;
+	rx_left = 0;
+	rx_raw[rx_left++] = 0x01;
+	for (index = 0; index <= length; index++)
+		if ((bytes[index] == 0x01) || (bytes[index] == 0x10) ||
+		    (bytes[index] == 0x11) || (bytes[index] == 0x13)) {
+			rx_raw[rx_left++] = 0x10;
+			rx_raw[rx_left++] = (char)(bytes[index] ^ 0x20);
+		} else
+			rx_raw[rx_left++] = (char)bytes[index];
+	rx_feed = rx_raw;
+}
+
+
+static void directive (const char *text)
+{
+	if (!strncmp(text, "cat in", 6))
+		cat_present = 1;
+	else if (!strncmp(text, "cat out", 7))
+		cat_present = 0;
+	else if (!strncmp(text, "start down", 10))
+		pins_b &= ~BIT(STARTBUTTON_BIT);
+	else if (!strncmp(text, "start up", 8))
+		pins_b |= BIT(STARTBUTTON_BIT);
+	else if (!strncmp(text, "setup down", 10))
+		pins_b &= ~BIT(SETUPBUTTON_BIT);
+	else if (!strncmp(text, "setup up", 8))
+		pins_b |= BIT(SETUPBUTTON_BIT);
+	else if (!strncmp(text, "supply off", 10))
+		water_supply = 0;
+	else if (!strncmp(text, "supply on", 9))
+		water_supply = 1;
+	else if (!strncmp(text, "send", 4))
+		feed_raw(text + 4, 0);
+	else if (!strncmp(text, "frame", 5))
+		feed_raw(text + 5, 1);
+	else if (!strncmp(text, "quit", 4))
+		finish();
+	else
+		fprintf(stderr, "Unknown directive '!%s'\n", text);
+}
+
+
+static void peripherals (unsigned long ticks)
+{
+	unsigned long	drained;
+
+	/* Water: the valve fills the bowl, the pump empties it */
+	if ((WATERVALVEPULLUP(LAT) & WATERVALVEPULLUP_MASK) && water_supply &&
+	    (water_level < SIM_FILLTIME)) {
+		water_level += ticks;
+		if (water_level > SIM_FILLTIME)
+			water_level = SIM_FILLTIME;
+	}
+	if (PUMP(LAT) & PUMP_MASK) {
+		drained = ticks * (SIM_FILLTIME / SIM_DRAINTIME);
+		water_level = (drained < water_level) ? (water_level - drained) : 0;
+	}
+
+	transmitter();
+
+	/* Water sensor: conversions complete instantly */
+	if (ADCON0bits.ADON && ADCON0bits.GO) {
+		ADRES = (water_level >= SIM_FILLTIME) ? ADC_SUBMERGED : ADC_DRY;
+		ADCON0bits.GO = 0;
+	}
+
+	/* Cat sensor: a ping runs while Timer2 interrupts are enabled */
+	if (TMR2IE) {
+		if (cat_present) {
+			/* The echo pulls the sensor output low */
+			pins_b &= ~CATSENSOR_MASK;
+			refresh_ports();
+			interrupts();
+			pins_b |= CATSENSOR_MASK;
+		}
+		TMR2IF = 1;
+	}
+
+	refresh_ports();
+
+	if (verbose && (LATD != latd_old)) {
+		print_time(stdout, now);
+		fprintf(stdout, "LATD 0x%.2X -> 0x%.2X\n", latd_old, LATD);
+		latd_old = LATD;
+	}
+}
+
+
+static void refresh_ports (void)
+{
+	unsigned char	changed;
+
+	/* Outputs follow the latches, inputs follow the pins */
+	PORTA = LATA & ~TRISA;
+	PORTB = (LATB & ~TRISB) | (pins_b & TRISB);
+	PORTC = LATC & ~TRISC;
+	PORTD = LATD & ~TRISD;
+	PORTE = LATE & ~TRISE;
+
+	/* Interrupt-on-change */
+	changed = PORTB ^ portb_old;
+	IOCBF |= (changed &  PORTB & IOCBP) |
+		 (changed & ~PORTB & IOCBN);
+	if (IOCBF)
+		IOCIF = 1;
+	portb_old = PORTB;
+}
+
+
+static unsigned char pending (void)
+{
+	return ( (TMR1IF && TMR1IE) ||
+		 (IOCIF  && IOCIE) ||
+		 (PEIE && ((TMR2IF && TMR2IE) || (RCIF && RCIE) ||
+			   ((TXREG == SIM_TXREG_EMPTY) && TXIE))) );
+}
+
+
+static void interrupts (void)
+{
+	if (!GIE)
+		return;
+
+	if (pending()) {
+		/* GIE is clear while the interrupt is served, until RETFIE */
+		GIE = 0;
+		sim_isr();
+		GIE = 1;
+	}
+}
+
+
+static void finish (void)
+{
+	FILE	*file;
+	double	host = (double)(clock() - host_start) / CLOCKS_PER_SEC;
+
+	fwrite(tx_line, 1, tx_len, stdout);
+	fflush(stdout);
+	if (eeprom_file && (file = fopen(eeprom_file, "wb"))) {
+		fwrite(eeprom, 1, sizeof(eeprom), file);
+		fclose(file);
+	}
+
+	fprintf(stderr, "Simulated ");
+	print_time(stderr, now);
+	fprintf(stderr, "in %.3fs host time, %lu loop passes, %lu sleeps (%.1f%% asleep)\n",
+		host, passes, sleeps, now ? (100.0 * asleep / now) : 0.0);
+	if (sim_tag_reads)
+		fprintf(stderr, "%lu tag block reads\n", sim_tag_reads);
+	if (eeprom_writes)
+		fprintf(stderr, "%lu EEPROM writes, %llu ms stalled on them\n",
+			eeprom_writes, eeprom_stalled / MILISECOND);
+	exit(0);
+}
+
+
+static void print_time (FILE *stream, unsigned long long ticks)
+{
+	unsigned long long	ms = ticks / (SECOND / 1000);
+
+	fprintf(stream, "[%.2llu:%.2llu:%.2llu.%.3llu] ",
+		ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000);
+}
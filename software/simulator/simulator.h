@@ -0,0 +1,21 @@
+/******************************************************************************/
+/* File    :	simulator.h						      */
+/* Function:	Include file of 'simulator.c'.				      */
+/******************************************************************************/
+
+#ifndef SIMULATOR_H			/* Include file already compiled? */
+#define SIMULATOR_H
+
+/* Provided by the application wrapper (e.g. catgenius_sim.c) */
+void		sim_firmware		(void) ;
+void		sim_isr			(void) ;
+
+/* Cartridge tag (cr14_sim.c) */
+extern unsigned long	sim_tag_reads;
+int		sim_tag_load		(const char	*path) ;
+
+/* Virtual time */
+unsigned long long sim_now		(void) ;
+void		sim_advance		(unsigned long	ticks) ;
+
+#endif /* SIMULATOR_H */